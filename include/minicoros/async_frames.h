@@ -0,0 +1,113 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_ASYNC_FRAMES_H_
+#define MINICOROS_ASYNC_FRAMES_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+/// Define `MINICOROS_ENABLE_ASYNC_FRAMES` (in every translation unit) to record the logical async call stack of
+/// every chain stage, see `mc::async_frame`. Requires `__builtin_FILE`/`__builtin_LINE` (GCC and Clang).
+#ifdef MINICOROS_ENABLE_ASYNC_FRAMES
+
+#include <stdio.h>
+
+/// Number of logical frames kept per stage; deeper stacks are truncated at the caller end
+#ifndef MINICOROS_ASYNC_FRAME_DEPTH
+  #define MINICOROS_ASYNC_FRAME_DEPTH 8
+#endif
+
+/// Trailing parameter/argument for functions that capture the location of their caller. Out-of-line definitions use
+/// the `_DEFINITION` variant, which leaves out the default argument.
+#define MINICOROS_ASYNC_LOCATION_PARAM , ::mc::async_location location = ::mc::async_location::current()
+#define MINICOROS_ASYNC_LOCATION_DEFINITION_PARAM , ::mc::async_location location
+#define MINICOROS_ASYNC_LOCATION_ARG , location
+
+namespace mc {
+
+/// Source location of a `.then`/`.fail`/... call.
+struct async_location {
+  const char* file;
+  unsigned line;
+
+  static constexpr async_location current(const char* file = __builtin_FILE(), unsigned line = __builtin_LINE()) {
+    return async_location{file, line};
+  }
+};
+
+/// The logical async stack of a chain stage: where the stage was attached, followed by the stack of the stage whose
+/// handler created the chain, and so on. Sampled stacks only show the handler that runs and the `std::function`
+/// frames that invoke it; this shows how the program got there.
+///
+/// Every stage carries a truncated copy of its creator's stack rather than a pointer to it, since the creating stage
+/// is usually gone by the time the stage runs. Capturing a frame is a copy of at most
+/// `MINICOROS_ASYNC_FRAME_DEPTH` locations and never allocates.
+struct async_frame {
+  async_location locations[MINICOROS_ASYNC_FRAME_DEPTH];
+  unsigned depth = 0;
+
+  static async_frame make(async_location location, const async_frame* parent) {
+    async_frame frame;
+    frame.locations[0] = location;
+    frame.depth = 1;
+
+    for (unsigned i = 0; parent && i < parent->depth && frame.depth < MINICOROS_ASYNC_FRAME_DEPTH; ++i)
+      frame.locations[frame.depth++] = parent->locations[i];
+
+    return frame;
+  }
+};
+
+namespace detail {
+
+/// Frame of the stage that is running on this thread. A namespace-scope variable so that debuggers can find it,
+/// see `tools/gdb/minicoros.py`.
+inline thread_local const async_frame* current_async_frame = nullptr;
+
+class async_frame_guard {
+public:
+  explicit async_frame_guard(const async_frame* frame) : previous_(current_async_frame) {
+    current_async_frame = frame;
+  }
+
+  ~async_frame_guard() {
+    current_async_frame = previous_;
+  }
+
+  async_frame_guard(const async_frame_guard&) = delete;
+  async_frame_guard& operator =(const async_frame_guard&) = delete;
+
+private:
+  const async_frame* previous_;
+};
+
+} // detail
+
+/// Returns the logical async stack of the running stage, or null outside of stages.
+inline const async_frame* current_async_frame() {
+  return detail::current_async_frame;
+}
+
+/// Prints the logical async stack of the running stage, innermost first.
+inline void print_async_stack(FILE* out = stderr) {
+  const async_frame* frame = current_async_frame();
+
+  if (!frame) {
+    fprintf(out, "<no async frame>\n");
+    return;
+  }
+
+  for (unsigned i = 0; i < frame->depth; ++i)
+    fprintf(out, "#%u %s:%u\n", i, frame->locations[i].file, frame->locations[i].line);
+}
+
+} // mc
+
+#else
+  #define MINICOROS_ASYNC_LOCATION_PARAM
+  #define MINICOROS_ASYNC_LOCATION_DEFINITION_PARAM
+  #define MINICOROS_ASYNC_LOCATION_ARG
+#endif // MINICOROS_ENABLE_ASYNC_FRAMES
+
+#endif // MINICOROS_ASYNC_FRAMES_H_
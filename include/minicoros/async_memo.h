@@ -0,0 +1,237 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_ASYNC_MEMO_H_
+#define MINICOROS_ASYNC_MEMO_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+#include <minicoros/future.h>
+#include <minicoros/detail/operation_helpers.h>
+
+#ifdef MINICOROS_USE_EASTL
+  #include <eastl/atomic.h>
+  #include <eastl/initializer_list.h>
+  #include <eastl/optional.h>
+  #include <eastl/shared_ptr.h>
+  #include <eastl/type_traits.h>
+  #include <eastl/utility.h>
+  #include <eastl/vector.h>
+  #include <stdint.h>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD eastl
+  #endif
+#else
+  #include <atomic>
+  #include <initializer_list>
+  #include <optional>
+  #include <memory>
+  #include <type_traits>
+  #include <utility>
+  #include <vector>
+  #include <cstdint>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD std
+  #endif
+#endif
+
+namespace mc {
+
+namespace detail {
+
+/// Untyped part of an `async_memo` node: the edges to the nodes that are derived from it.
+class memo_node_base : public MINICOROS_STD::enable_shared_from_this<memo_node_base> {
+public:
+  virtual ~memo_node_base() = default;
+
+  void add_dependent(MINICOROS_STD::weak_ptr<memo_node_base>&& dependent) {
+    dependents_.push_back(MINICOROS_STD::move(dependent));
+  }
+
+  /// Drops the cached value of this node and of everything derived from it. Each node is visited once per call, so
+  /// diamonds in the graph don't multiply the work.
+  void invalidate() {
+    invalidate(invalidation_counter().fetch_add(1, MINICOROS_STD::memory_order_relaxed) + 1);
+  }
+
+protected:
+  virtual void mark_stale() = 0;
+
+private:
+  /// Process-wide, so that a graph that's used from different threads in turn never sees the same number twice
+  static MINICOROS_STD::atomic<uint64_t>& invalidation_counter() {
+    static MINICOROS_STD::atomic<uint64_t> counter{0};
+    return counter;
+  }
+
+  void invalidate(uint64_t invalidation) {
+    if (last_invalidation_ == invalidation)
+      return;
+
+    last_invalidation_ = invalidation;
+    mark_stale();
+
+    size_t num_alive = 0;
+
+    for (size_t i = 0; i < dependents_.size(); ++i) {
+      if (auto dependent = dependents_[i].lock()) {
+        dependent->invalidate(invalidation);
+        dependents_[num_alive++] = MINICOROS_STD::move(dependents_[i]);
+      }
+    }
+
+    dependents_.resize(num_alive); // Forget the nodes that are gone
+  }
+
+  MINICOROS_STD::vector<MINICOROS_STD::weak_ptr<memo_node_base>> dependents_;
+  uint64_t last_invalidation_ = 0;
+};
+
+template<typename T>
+class memo_node : public memo_node_base {
+public:
+  explicit memo_node(MINICOROS_FUNCTION_TYPE<future<T>()>&& compute) : compute_(MINICOROS_STD::move(compute)) {}
+
+  void get(promise<T>&& p) {
+    if (value_) {
+      p(concrete_result<T>{T{*value_}});
+      return;
+    }
+
+    waiters_.push_back(MINICOROS_STD::move(p));
+
+    if (!computing_)
+      start();
+  }
+
+  bool has_value() const {
+    return value_.has_value();
+  }
+
+  bool computing() const {
+    return computing_;
+  }
+
+  size_t num_computations() const {
+    return num_computations_;
+  }
+
+protected:
+  void mark_stale() override {
+    ++version_;
+    value_.reset();
+  }
+
+private:
+  void start() {
+    computing_ = true;
+    ++num_computations_;
+
+    auto self = MINICOROS_STD::static_pointer_cast<memo_node>(shared_from_this());
+
+    compute_().chain().evaluate_into([self = MINICOROS_STD::move(self), version = version_] (concrete_result<T>&& result) {
+      self->finish(version, MINICOROS_STD::move(result));
+    });
+  }
+
+  void finish(uint64_t version, concrete_result<T>&& result) {
+    computing_ = false;
+
+    // Invalidated while computing: the result is already out of date, so the waiters get the next one
+    if (version != version_) {
+      start();
+      return;
+    }
+
+    if (result.success())
+      value_.emplace(*result.get_value());
+
+    // Waiters may invalidate the node again, so hand out copies of the result rather than of the cache
+    auto waiters = MINICOROS_STD::move(waiters_);
+    waiters_.clear();
+
+    for (promise<T>& waiter : waiters)
+      waiter(concrete_result<T>{result});
+  }
+
+  MINICOROS_FUNCTION_TYPE<future<T>()> compute_;
+  MINICOROS_STD::optional<T> value_;
+  MINICOROS_STD::vector<promise<T>> waiters_;
+  uint64_t version_ = 0;
+  size_t num_computations_ = 0;
+  bool computing_ = false;
+};
+
+} // detail
+
+/// A memoized asynchronous value that is derived from other memoized values. The value is computed on the first
+/// `get` and cached; readers that arrive while it's being computed share the computation. Invalidating a node drops
+/// its cached value and those of all nodes derived from it, directly or indirectly, so that they're recomputed on
+/// their next `get`. Nodes that don't depend on it keep their values.
+///
+/// ```cpp
+/// mc::async_memo<config> cfg{[] { return load_config(); }};
+/// mc::async_memo<routing_table> routes{[cfg] {
+///   return cfg.get().then([] (config c) -> mc::result<routing_table> { return build_routes(c); });
+/// }, {cfg}};
+///
+/// cfg.invalidate(); // The next routes.get() reloads the config and rebuilds the routes
+/// ```
+///
+/// An invalidation that arrives while a node is being computed discards the result and starts over, so readers
+/// never get a value that is older than their last invalidation. Failures aren't cached. Handles are cheap to copy
+/// and share the node; dependencies are declared explicitly and have to exist before the nodes derived from them.
+/// Not thread-safe.
+template<typename T>
+class async_memo {
+public:
+  static_assert(!MINICOROS_STD::is_void_v<T>, "async_memo has to produce a value");
+
+  using compute_type = MINICOROS_FUNCTION_TYPE<future<T>()>;
+
+  explicit async_memo(compute_type&& compute, MINICOROS_STD::initializer_list<MINICOROS_STD::shared_ptr<detail::memo_node_base>> dependencies = {})
+    : node_(detail::make_shared_state<detail::memo_node<T>>(MINICOROS_STD::move(compute))) {
+    for (const auto& dependency : dependencies)
+      dependency->add_dependent(MINICOROS_STD::weak_ptr<detail::memo_node_base>{node_});
+  }
+
+  /// Returns a future of the value, computing it if it isn't cached yet.
+  future<T> get() const {
+    return future<T>([node = node_] (promise<T>&& p) {
+      node->get(MINICOROS_STD::move(p));
+    });
+  }
+
+  /// Drops the cached value of this node and of every node derived from it.
+  void invalidate() {
+    node_->invalidate();
+  }
+
+  bool has_value() const {
+    return node_->has_value();
+  }
+
+  bool computing() const {
+    return node_->computing();
+  }
+
+  /// Number of times the value has been computed, for tests and statistics
+  size_t num_computations() const {
+    return node_->num_computations();
+  }
+
+  /// For declaring this node as a dependency of another one
+  operator MINICOROS_STD::shared_ptr<detail::memo_node_base>() const {
+    return node_;
+  }
+
+private:
+  MINICOROS_STD::shared_ptr<detail::memo_node<T>> node_;
+};
+
+} // mc
+
+#endif // MINICOROS_ASYNC_MEMO_H_
@@ -0,0 +1,597 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_CONTEXT_H_
+#define MINICOROS_CONTEXT_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+#ifdef MINICOROS_USE_EASTL
+  #include <eastl/atomic.h>
+  #include <eastl/chrono.h>
+  #include <eastl/shared_ptr.h>
+  #include <eastl/utility.h>
+  #include <eastl/vector.h>
+  #include <stdint.h>
+  #include <cassert>
+  #include <new>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD eastl
+  #endif
+#else
+  #include <atomic>
+  #include <chrono>
+  #include <memory>
+  #include <utility>
+  #include <vector>
+  #include <cstdint>
+  #include <cassert>
+  #include <new>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD std
+  #endif
+#endif
+
+#ifndef MINICOROS_ERROR_TYPE
+  #define MINICOROS_ERROR_TYPE int
+#endif
+
+/// Define `MINICOROS_ENABLE_CPU_ACCOUNTING` (in every translation unit) to measure the on-CPU time of the stages that
+/// run within each `mc::context`, see `context::cpu_time` and `mc::cpu_accounting`. POSIX only.
+#ifdef MINICOROS_ENABLE_CPU_ACCOUNTING
+  #include <time.h>
+  #include <string.h>
+  #include <mutex>
+#endif
+
+namespace mc {
+
+class context;
+
+namespace detail {
+
+/// The context of the stage that's currently running on this thread. Chains own their context, so a raw pointer is
+/// enough here; installing a context doesn't touch the reference count.
+inline context*& current_context_slot() {
+  thread_local context* current = nullptr;
+  return current;
+}
+
+/// Node of an immutable list of `async_local` values, keyed by the address of the `async_local`. Chains share the
+/// list they inherited and prepend to it when a value is set, so setting a value never affects another chain.
+struct local_node {
+  explicit local_node(const void* key, MINICOROS_STD::shared_ptr<local_node>&& next) : key(key), next(MINICOROS_STD::move(next)) {}
+  virtual ~local_node() = default;
+
+  const void* key;
+  MINICOROS_STD::shared_ptr<local_node> next;
+};
+
+template<typename T>
+struct typed_local_node : local_node {
+  typed_local_node(const void* key, T&& value, MINICOROS_STD::shared_ptr<local_node>&& next)
+    : local_node(key, MINICOROS_STD::move(next)), value(MINICOROS_STD::move(value)) {}
+
+  T value;
+};
+
+using locals_ptr = MINICOROS_STD::shared_ptr<local_node>;
+
+/// The `async_local` values of the running stage (or `context_scope`), or null outside of a context.
+inline locals_ptr*& current_locals_slot() {
+  thread_local locals_ptr* current = nullptr;
+  return current;
+}
+
+#ifdef MINICOROS_ENABLE_CPU_ACCOUNTING
+inline int64_t thread_cpu_time_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/// Thread CPU time at which the current context was installed
+inline int64_t& context_switch_time_slot() {
+  thread_local int64_t switch_time = 0;
+  return switch_time;
+}
+#endif
+
+} // detail
+
+#ifdef MINICOROS_ENABLE_CPU_ACCOUNTING
+/// Process-wide CPU time per context name. Contexts add their time when they're destroyed, ie, when the last chain
+/// of the request has finished.
+class cpu_accounting {
+public:
+  struct entry {
+    const char* name;
+    MINICOROS_STD::chrono::nanoseconds cpu_time;
+    size_t num_contexts;
+  };
+
+  static void record(const char* name, MINICOROS_STD::chrono::nanoseconds cpu_time) {
+    registry& reg = get_registry();
+    std::lock_guard<std::mutex> lock{reg.mutex};
+
+    for (entry& e : reg.entries) {
+      if (strcmp(e.name, name) == 0) {
+        e.cpu_time += cpu_time;
+        ++e.num_contexts;
+        return;
+      }
+    }
+
+    reg.entries.push_back(entry{name, cpu_time, 1});
+  }
+
+  static MINICOROS_STD::vector<entry> snapshot() {
+    registry& reg = get_registry();
+    std::lock_guard<std::mutex> lock{reg.mutex};
+    return reg.entries;
+  }
+
+  static void reset() {
+    registry& reg = get_registry();
+    std::lock_guard<std::mutex> lock{reg.mutex};
+    reg.entries.clear();
+  }
+
+private:
+  struct registry {
+    std::mutex mutex;
+    MINICOROS_STD::vector<entry> entries;
+  };
+
+  static registry& get_registry() {
+    static registry reg;
+    return reg;
+  }
+};
+#endif
+
+/// Request-scoped state that follows a chain through all of its stages: a deadline, a cancellation flag, a tracing
+/// id and a priority. Every chain captures the context that is current when it's created, and makes it current again
+/// while its stages run. Futures created inside a handler therefore inherit the context of the handler's chain,
+/// including the ones created by combinators. Each chain holds one reference to its context, which its stages borrow.
+///
+/// Once the context has expired (the deadline has passed, it has been cancelled or it went over its memory quota),
+/// `.then` handlers are skipped and the chain fails with the context's `expiry_error` instead. `.fail` handlers still
+/// run so they can react to it.
+///
+/// ```cpp
+/// auto ctx = mc::make_context(ETIMEDOUT);
+/// ctx->set_deadline(mc::context::clock::now() + 100ms);
+///
+/// mc::context_scope scope{ctx};
+/// handle_request(request) // Chains created in here carry `ctx`
+///   .fail([] (int error) { ... });
+/// ```
+class context : public MINICOROS_STD::enable_shared_from_this<context> {
+public:
+  using clock = MINICOROS_STD::chrono::steady_clock;
+
+  explicit context(MINICOROS_ERROR_TYPE&& expired_error) : expired_error_(MINICOROS_STD::move(expired_error)), quota_error_(expired_error_) {}
+
+  context(const context&) = delete;
+  context& operator =(const context&) = delete;
+
+#ifdef MINICOROS_ENABLE_CPU_ACCOUNTING
+  ~context() {
+    if (name_)
+      cpu_accounting::record(name_, cpu_time());
+  }
+#endif
+
+  /// Name used for aggregating the CPU time in `mc::cpu_accounting`. Must have static storage duration.
+  void set_name(const char* name) {
+    name_ = name;
+  }
+
+  const char* name() const {
+    return name_;
+  }
+
+  /// CPU time spent in stages running within this context, summed over all threads. Includes the running stage if
+  /// it belongs to this context. Always zero unless `MINICOROS_ENABLE_CPU_ACCOUNTING` is defined.
+  MINICOROS_STD::chrono::nanoseconds cpu_time() const {
+    int64_t cpu_time_ns = cpu_time_ns_.load(MINICOROS_STD::memory_order_relaxed);
+
+#ifdef MINICOROS_ENABLE_CPU_ACCOUNTING
+    if (detail::current_context_slot() == this)
+      cpu_time_ns += detail::thread_cpu_time_ns() - detail::context_switch_time_slot();
+#endif
+
+    return MINICOROS_STD::chrono::nanoseconds{cpu_time_ns};
+  }
+
+  void charge_cpu_time(int64_t cpu_time_ns) {
+    cpu_time_ns_.fetch_add(cpu_time_ns, MINICOROS_STD::memory_order_relaxed);
+  }
+
+  void set_deadline(clock::time_point deadline) {
+    deadline_ = deadline;
+  }
+
+  clock::time_point deadline() const {
+    return deadline_;
+  }
+
+  /// Makes the context expire. Safe to call from any thread.
+  void cancel() {
+    cancelled_.store(true, MINICOROS_STD::memory_order_relaxed);
+  }
+
+  bool cancelled() const {
+    return cancelled_.load(MINICOROS_STD::memory_order_relaxed);
+  }
+
+  bool expired() const {
+    return cancelled() || over_quota() || (deadline_ != clock::time_point::max() && clock::now() >= deadline_);
+  }
+
+  void set_trace_id(uint64_t trace_id) {
+    trace_id_ = trace_id;
+  }
+
+  uint64_t trace_id() const {
+    return trace_id_;
+  }
+
+  void set_priority(int priority) {
+    priority_ = priority;
+  }
+
+  int priority() const {
+    return priority_;
+  }
+
+  /// The error that chains fail with once the deadline has passed or the context has been cancelled.
+  const MINICOROS_ERROR_TYPE& expired_error() const {
+    return expired_error_;
+  }
+
+  /// The error that chains fail with now that the context has expired.
+  const MINICOROS_ERROR_TYPE& expiry_error() const {
+    return over_quota() ? quota_error_ : expired_error_;
+  }
+
+  /// Limits the memory that the library allocates on behalf of the context's chains: chain links, the state and
+  /// fan-out of combinators, and buffers allocated through `mc::quota_allocator`. Once the quota is exceeded, the
+  /// context expires for good and its chains fail with `quota_error`. Combinators whose fan-out doesn't fit into the
+  /// quota fail before they start any of their futures, so a runaway `when_all` fails instead of exhausting memory.
+  ///
+  /// Set the quota before creating chains; memory allocated before that isn't accounted for.
+  void set_memory_quota(size_t bytes, MINICOROS_ERROR_TYPE&& quota_error) {
+    quota_error_ = MINICOROS_STD::move(quota_error);
+    memory_quota_ = bytes;
+  }
+
+  bool has_memory_quota() const {
+    return memory_quota_ != SIZE_MAX;
+  }
+
+  size_t memory_quota() const {
+    return memory_quota_;
+  }
+
+  size_t memory_used() const {
+    return memory_used_.load(MINICOROS_STD::memory_order_relaxed);
+  }
+
+  bool over_quota() const {
+    return over_quota_.load(MINICOROS_STD::memory_order_relaxed);
+  }
+
+  /// Accounts for memory that has already been allocated. Marks the context as over quota if it no longer fits.
+  void charge_memory(size_t bytes) {
+    if (memory_used_.fetch_add(bytes, MINICOROS_STD::memory_order_relaxed) + bytes > memory_quota_)
+      over_quota_.store(true, MINICOROS_STD::memory_order_relaxed);
+  }
+
+  /// Accounts for memory that is about to be allocated. If it doesn't fit, nothing is charged, the context is marked
+  /// as over quota and false is returned.
+  bool try_charge_memory(size_t bytes) {
+    size_t used = memory_used_.load(MINICOROS_STD::memory_order_relaxed);
+
+    do {
+      if (bytes > memory_quota_ - used || used > memory_quota_) {
+        over_quota_.store(true, MINICOROS_STD::memory_order_relaxed);
+        return false;
+      }
+    } while (!memory_used_.compare_exchange_weak(used, used + bytes, MINICOROS_STD::memory_order_relaxed));
+
+    return true;
+  }
+
+  void release_memory(size_t bytes) {
+    memory_used_.fetch_sub(bytes, MINICOROS_STD::memory_order_relaxed);
+  }
+
+private:
+  clock::time_point deadline_ = clock::time_point::max();
+  MINICOROS_STD::atomic<bool> cancelled_{false};
+  uint64_t trace_id_ = 0;
+  int priority_ = 0;
+  const char* name_ = nullptr;
+  MINICOROS_STD::atomic<int64_t> cpu_time_ns_{0};
+  MINICOROS_ERROR_TYPE expired_error_;
+  MINICOROS_ERROR_TYPE quota_error_;
+  size_t memory_quota_ = SIZE_MAX;
+  MINICOROS_STD::atomic<size_t> memory_used_{0};
+  MINICOROS_STD::atomic<bool> over_quota_{false};
+};
+
+using context_ptr = MINICOROS_STD::shared_ptr<context>;
+
+inline context_ptr make_context(MINICOROS_ERROR_TYPE&& expired_error) {
+  return MINICOROS_STD::make_shared<context>(MINICOROS_STD::move(expired_error));
+}
+
+namespace detail {
+
+/// Installs `next` as the current context. With CPU accounting, the time since the previous switch is charged to the
+/// context that's being replaced.
+inline void switch_current_context(context* next) {
+  context*& current = current_context_slot();
+
+#ifdef MINICOROS_ENABLE_CPU_ACCOUNTING
+  if (current != next) {
+    int64_t now = thread_cpu_time_ns();
+
+    if (current)
+      current->charge_cpu_time(now - context_switch_time_slot());
+
+    context_switch_time_slot() = now;
+  }
+#endif
+
+  current = next;
+}
+
+/// The context and `async_local` values of an evaluated chain within a context. Its links borrow it, see
+/// `state_owning_sink`. Until it's evaluated, a chain only holds the context and the values that were set when it was
+/// created; a future that a stage returns then shares the state of the stage's chain instead of getting its own, see
+/// `continuation_chain::evaluate_as_continuation_into`.
+struct chain_state {
+  context_ptr ctx;
+  locals_ptr locals;
+};
+
+/// The state of the running stage, or null outside of a stage (or within a `context_scope`)
+inline chain_state*& current_chain_state_slot() {
+  thread_local chain_state* current = nullptr;
+  return current;
+}
+
+/// Makes a context and its `async_local` values current for the lifetime of the guard.
+class context_guard {
+public:
+  context_guard(context* ctx, locals_ptr* locals) : context_guard(ctx, locals, nullptr) {}
+
+  explicit context_guard(chain_state* state) : context_guard(state ? state->ctx.get() : nullptr, state ? &state->locals : nullptr, state) {}
+
+  ~context_guard() {
+    switch_current_context(previous_);
+    current_locals_slot() = previous_locals_;
+    current_chain_state_slot() = previous_state_;
+  }
+
+  context_guard(const context_guard&) = delete;
+  context_guard& operator =(const context_guard&) = delete;
+
+private:
+  context_guard(context* ctx, locals_ptr* locals, chain_state* state)
+    : previous_(current_context_slot()), previous_locals_(current_locals_slot()), previous_state_(current_chain_state_slot()) {
+    switch_current_context(ctx);
+    current_locals_slot() = locals;
+    current_chain_state_slot() = state;
+  }
+
+  context* previous_;
+  locals_ptr* previous_locals_;
+  chain_state* previous_state_;
+};
+
+/// Used by allocators to capture the current context when they're created.
+inline context_ptr capture_context() {
+  context* ctx = current_context_slot();
+  return ctx ? ctx->shared_from_this() : context_ptr{};
+}
+
+/// Used by chains to capture the current `async_local` values when they're created, along with `capture_context`.
+inline locals_ptr capture_locals() {
+  locals_ptr* locals = current_locals_slot();
+  return locals ? *locals : locals_ptr{};
+}
+
+/// Memory charged to the current context for the lifetime of the reservation, see `context::set_memory_quota`.
+/// Empty if the context has no quota.
+class memory_reservation {
+public:
+  memory_reservation() = default;
+
+  explicit memory_reservation(size_t bytes) {
+    context* ctx = current_context_slot();
+
+    if (!ctx || !ctx->has_memory_quota())
+      return;
+
+    if (!ctx->try_charge_memory(bytes)) {
+      rejected_ = true;
+      return;
+    }
+
+    context_ = ctx->shared_from_this();
+    bytes_ = bytes;
+  }
+
+  memory_reservation(memory_reservation&& other)
+    : context_(MINICOROS_STD::move(other.context_)), bytes_(other.bytes_), rejected_(other.rejected_) {
+    other.bytes_ = 0;
+  }
+
+  memory_reservation(const memory_reservation&) = delete;
+  memory_reservation& operator =(const memory_reservation&) = delete;
+
+  ~memory_reservation() {
+    if (bytes_)
+      context_->release_memory(bytes_);
+  }
+
+  /// Whether the memory didn't fit into the quota
+  bool rejected() const {
+    return rejected_;
+  }
+
+  explicit operator bool() const {
+    return bytes_ != 0;
+  }
+
+private:
+  context_ptr context_;
+  size_t bytes_ = 0;
+  bool rejected_ = false;
+};
+
+} // detail
+
+/// Returns the context of the running stage, or null if it doesn't have one. The chain keeps the context alive until
+/// it has resolved, so once a stage has resolved the last promise of its chain, the context may already be gone; keep
+/// a `shared_from_this()` to use it after that.
+inline context* current_context() {
+  return detail::current_context_slot();
+}
+
+/// Makes `ctx` the current context until the scope ends. Use it where a request enters the system; chains created
+/// within the scope capture the context, and the `async_local` values set within the scope.
+class context_scope {
+public:
+  explicit context_scope(const context_ptr& ctx) : guard_(ctx.get(), ctx ? &locals_ : nullptr) {}
+
+private:
+  detail::locals_ptr locals_;
+  detail::context_guard guard_;
+};
+
+/// Request-scoped variable, the async counterpart of `thread_local`. A value that's set in a stage is seen by the later
+/// stages of the chain, across `enqueue` hops, and by the futures that are created after it was set, including the
+/// branches of combinators. It isn't seen by the chain's siblings or parents: a value that a branch of a `when_all`
+/// sets stays within that branch, and the chain that awaits the branches keeps its own value. A future that a stage
+/// returns is the exception: it continues the stage's chain, so it sees the chain's values as they are when the stage
+/// returns, and the values it sets are seen by the later stages. Values are looked up by the address of the
+/// `async_local`, so declare them with static storage duration.
+///
+/// ```cpp
+/// static mc::async_local<user_id> current_user;
+///
+/// authenticate(request)
+///   .then([] (user_id user) { current_user.set(user); })
+///   .enqueue(worker_pool)
+///   .then([] { audit_log(*current_user.get()); });
+/// ```
+///
+/// Values are immutable once they've been handed out, so a chain's branches can read them concurrently. Setting a
+/// value allocates, unless the chain is overwriting a value it set itself that nothing else has seen yet.
+template<typename T>
+class async_local {
+public:
+  async_local() = default;
+  async_local(const async_local&) = delete;
+  async_local& operator =(const async_local&) = delete;
+
+  /// Returns the value of the running chain, or null if it hasn't been set (or there is no context). The value stays
+  /// valid for as long as the pointer is held, even if it's set again.
+  MINICOROS_STD::shared_ptr<const T> get() const {
+    const detail::locals_ptr* owner = detail::current_locals_slot();
+
+    if (!owner)
+      return {};
+
+    for (const detail::local_node* node = owner->get(); node; owner = &node->next, node = owner->get()) {
+      if (node->key == this)
+        return MINICOROS_STD::shared_ptr<const T>(*owner, &static_cast<const detail::typed_local_node<T>*>(node)->value);
+    }
+
+    return {};
+  }
+
+  /// Sets the value for the rest of the running chain and the futures that it creates from now on. Returns false,
+  /// without setting anything, if there is no current context.
+  bool set(T value) {
+    detail::locals_ptr* locals = detail::current_locals_slot();
+
+    if (!locals)
+      return false;
+
+    // Nothing else holds the node, so no other chain or reader can tell the difference
+    if (*locals && (*locals)->key == this && locals->use_count() == 1) {
+      static_cast<detail::typed_local_node<T>&>(**locals).value = MINICOROS_STD::move(value);
+      return true;
+    }
+
+    *locals = MINICOROS_STD::make_shared<detail::typed_local_node<T>>(this, MINICOROS_STD::move(value), MINICOROS_STD::move(*locals));
+    return true;
+  }
+};
+
+/// Allocator that charges its allocations to a context's memory quota, for buffers that a chain allocates or captures
+/// on its own, see `context::set_memory_quota`. Uses the current context unless one is given. Allocations never
+/// fail; one that exceeds the quota makes the context expire, failing its chains at their next stage.
+///
+/// ```cpp
+/// .then([] (request&& req) {
+///   std::vector<char, mc::quota_allocator<char>> body;
+///   body.resize(req.content_length);
+///   ...
+/// })
+/// ```
+template<typename T>
+class quota_allocator {
+public:
+  using value_type = T;
+
+  quota_allocator() : context_(detail::capture_context()) {}
+  explicit quota_allocator(context_ptr ctx) : context_(MINICOROS_STD::move(ctx)) {}
+
+  template<typename U>
+  quota_allocator(const quota_allocator<U>& other) : context_(other.get_context()) {}
+
+  T* allocate(size_t n) {
+    if (context_)
+      context_->charge_memory(n * sizeof(T));
+
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    if (context_)
+      context_->release_memory(n * sizeof(T));
+
+    ::operator delete(ptr);
+  }
+
+  const context_ptr& get_context() const {
+    return context_;
+  }
+
+  template<typename U>
+  bool operator ==(const quota_allocator<U>& other) const {
+    return context_ == other.get_context();
+  }
+
+  template<typename U>
+  bool operator !=(const quota_allocator<U>& other) const {
+    return context_ != other.get_context();
+  }
+
+private:
+  context_ptr context_;
+};
+
+} // mc
+
+#endif // MINICOROS_CONTEXT_H_
@@ -7,9 +7,24 @@
   #include MINICOROS_CUSTOM_INCLUDE
 #endif
 
+#include <minicoros/context.h>
+#include <minicoros/stage_budget.h>
+#include <minicoros/flight_recorder.h>
+#include <minicoros/async_frames.h>
+
 #ifdef MINICOROS_USE_EASTL
+  /// Inline capture size of the chain nodes. Every node embeds its parent, so `eastl::fixed_function` (which can't
+  /// overflow to the heap) can't hold them; the SBO of `eastl::function` is enlarged instead. Has to be defined
+  /// before EASTL's functional header is included anywhere else.
+  #if defined(MINICOROS_EASTL_FUNCTION_SSO_SIZE) && !defined(EASTL_FUNCTION_DEFAULT_CAPTURE_SSO_SIZE)
+    #define EASTL_FUNCTION_DEFAULT_CAPTURE_SSO_SIZE MINICOROS_EASTL_FUNCTION_SSO_SIZE
+  #endif
+
   #include <eastl/utility.h>
   #include <eastl/functional.h>
+  #include <eastl/type_traits.h>
+  #include <eastl/optional.h>
+  #include <new>
   #include <cassert>
 
   #ifndef MINICOROS_STD
@@ -22,6 +37,9 @@
 #else
   #include <utility>
   #include <functional>
+  #include <type_traits>
+  #include <optional>
+  #include <new>
   #include <cassert>
 
   #ifndef MINICOROS_STD
@@ -41,6 +59,281 @@ using continuation = MINICOROS_FUNCTION_TYPE<void(ResultType&&)>;
 template<typename InputType, typename OutputType>
 using functor = MINICOROS_FUNCTION_TYPE<void(InputType&&, continuation<OutputType>&&)>;
 
+namespace detail {
+
+/// With `MINICOROS_BROKEN_PROMISE_ERROR`, tells whether a dropped continuation of `T` can be resolved with the broken
+/// promise error and creates that result. Specialized for `concrete_result` in types.h.
+template<typename T>
+struct broken_promise_result {
+  static constexpr bool supported = false;
+};
+
+/// The rest of a chain that was handed to the executor of an exhausted `stage_budget`.
+template<typename LinkType, typename T>
+struct rescheduled_link {
+  LinkType link;
+  T input;
+
+  void operator()() {
+    link.run(MINICOROS_STD::move(input));
+  }
+};
+
+/// A link in a continuation chain. The same object type is used both as the activator of the link (invoked with the
+/// continuation of the next link) and, once activated, as the continuation that the parent resolves into. Using one
+/// type for both roles means that each transformation only adds one type-erased functor type for the compiler to
+/// instantiate, instead of one per role.
+template<typename T, typename ResultType, typename TransformType>
+class chain_link {
+  using ActivatorType = continuation<continuation<T>>;
+  using NextType = continuation<ResultType>;
+
+public:
+  static_assert(!MINICOROS_STD::is_same_v<T, NextType>, "chain links can't transform continuations");
+
+  chain_link(TransformType&& transformation, ActivatorType&& parent_activator, context* ctx)
+    : transformation_(MINICOROS_STD::move(transformation)), context_(ctx), activated_(false) {
+    new (&parent_activator_) ActivatorType(MINICOROS_STD::move(parent_activator));
+
+    // Activation moves the link into a new one, which inherits the charge along with the context
+    if (ctx && ctx->has_memory_quota()) {
+      ctx->charge_memory(sizeof(chain_link));
+      charged_ = true;
+    }
+  }
+
+  chain_link(TransformType&& transformation, NextType&& next_continuation, chain_state* state)
+    : transformation_(MINICOROS_STD::move(transformation)), state_(state), activated_(true), pending_(true) {
+    new (&next_continuation_) NextType(MINICOROS_STD::move(next_continuation));
+  }
+
+  chain_link(chain_link&& other)
+    : transformation_(MINICOROS_STD::move(other.transformation_))
+    , activated_(other.activated_)
+    , pending_(other.pending_)
+    , charged_(other.charged_) {
+    other.pending_ = false;
+    other.charged_ = false;
+
+    if (activated_) {
+      state_ = other.state_;
+      new (&next_continuation_) NextType(MINICOROS_STD::move(other.next_continuation_));
+    }
+    else {
+      context_ = other.context_;
+      new (&parent_activator_) ActivatorType(MINICOROS_STD::move(other.parent_activator_));
+    }
+
+#ifdef MINICOROS_ENABLE_ASYNC_FRAMES
+    frame_ = other.frame_;
+#endif
+#ifdef MINICOROS_BROKEN_PROMISE_ERROR
+    copied_ = other.copied_;
+#endif
+  }
+
+  // NOTE: a copy is a full copy, like the copy of any other continuation: it holds its own copy of the transformation
+  //       and of the rest of the chain, and runs them when it's invoked. Promises are continuations, so this is what
+  //       stashing a promise in a copyable function relies on. The memory quota charge stays with the original.
+  chain_link(const chain_link& other)
+    : transformation_(other.transformation_)
+    , activated_(other.activated_)
+    , pending_(other.pending_) {
+    if (activated_) {
+      state_ = other.state_;
+      new (&next_continuation_) NextType(other.next_continuation_);
+    }
+    else {
+      context_ = other.context_;
+      new (&parent_activator_) ActivatorType(other.parent_activator_);
+    }
+
+#ifdef MINICOROS_ENABLE_ASYNC_FRAMES
+    frame_ = other.frame_;
+#endif
+#ifdef MINICOROS_BROKEN_PROMISE_ERROR
+    // Any copy may be the one that's going to be invoked, so dropping the others isn't a broken promise
+    copied_ = other.copied_ = true;
+#endif
+  }
+
+  ~chain_link() {
+#ifdef MINICOROS_BROKEN_PROMISE_ERROR
+    // The promise was dropped without being invoked, so fail the rest of the chain instead of leaving it hanging
+    if constexpr (broken_promise_result<T>::supported) {
+      if (activated_ && pending_ && !copied_)
+        run(broken_promise_result<T>::make());
+    }
+#endif
+
+    // Before the continuation, which may hold the last reference to the context
+    if (charged_)
+      (activated_ ? state_->ctx.get() : context_)->release_memory(sizeof(chain_link));
+
+    if (activated_)
+      next_continuation_.~NextType();
+    else
+      parent_activator_.~ActivatorType();
+  }
+
+  /// Activator role: binds the transformation to the next continuation and activates the parent with it.
+  void operator()(NextType&& next_continuation) {
+    assert(!activated_ && "chain link activated more than once");
+
+    if (activated_)
+      return;
+
+    // Links are activated while their chain is being evaluated, see `continuation_chain::evaluate_into`
+    chain_state* state = current_chain_state_slot();
+    assert(!state == !context_ && "chain link activated outside of the evaluation of its chain");
+
+#ifdef MINICOROS_ENABLE_ASYNC_FRAMES
+    chain_link activated{MINICOROS_STD::move(*transformation_), MINICOROS_STD::move(next_continuation), state};
+    activated.frame_ = frame_;
+    activated.charged_ = MINICOROS_STD::exchange(charged_, false);
+    parent_activator_(MINICOROS_STD::move(activated));
+#else
+    chain_link activated{MINICOROS_STD::move(*transformation_), MINICOROS_STD::move(next_continuation), state};
+    activated.charged_ = MINICOROS_STD::exchange(charged_, false);
+    parent_activator_(MINICOROS_STD::move(activated));
+#endif
+  }
+
+  /// Continuation role: invoked when the parent resolves. This is the part of the evaluation flow that actually calls
+  /// the code and binds it with a continuation that evaluates the next functor of the chain.
+  void operator()(T&& input) {
+    assert(pending_ && "promise invoked more than once");
+
+    // The continuation was moved into the first invocation, so a second one has nothing to run
+    if (!pending_)
+      return;
+
+    MINICOROS_RECORD_EVENT(flight_event::promise_resolved, this);
+
+    if (stage_budget* budget = stage_budget::current(); budget && budget->consume()) {
+      budget->reschedule(rescheduled_link<chain_link, T>{MINICOROS_STD::move(*this), MINICOROS_STD::move(input)});
+      return;
+    }
+
+    run(MINICOROS_STD::move(input));
+  }
+
+  /// Runs the transformation regardless of the stage budget.
+  void run(T&& input) {
+    pending_ = false;
+#ifdef MINICOROS_ENABLE_CPU_ACCOUNTING
+    // Switching away from the context charges it, and the stage may resolve the chain and release the context
+    context_ptr pinned_context = state_ ? state_->ctx : context_ptr{};
+#endif
+    context_guard guard{state_};
+#ifdef MINICOROS_ENABLE_ASYNC_FRAMES
+    async_frame_guard frame_guard{&frame_};
+#endif
+    MINICOROS_RECORD_EVENT(flight_event::stage_entered, this);
+
+    // The link itself lives on in the promise that resolved it, possibly until the whole chain has resolved. Run the
+    // transformation from a local so that its captures are released as soon as the stage has run.
+    TransformType transformation{MINICOROS_STD::move(*transformation_)};
+    transformation_.reset();
+
+    if (charged_) {
+      state_->ctx->release_memory(sizeof(chain_link));
+      charged_ = false;
+    }
+
+    transformation(MINICOROS_STD::move(input), MINICOROS_STD::move(next_continuation_));
+  }
+
+#ifdef MINICOROS_ENABLE_ASYNC_FRAMES
+  /// Records where the link was attached, see `mc::async_frame`.
+  void set_frame(async_location location) {
+    frame_ = async_frame::make(location, current_async_frame);
+  }
+#endif
+
+private:
+  MINICOROS_STD::optional<TransformType> transformation_; // Empty in inert copies and once the stage has run
+
+  // The state of a chain is only created when the chain is evaluated, which is when its links are activated
+  union {
+    context* context_;   // Waiting for activation
+    chain_state* state_; // Activated. Borrowed, see `state_owning_sink`
+  };
+#ifdef MINICOROS_ENABLE_ASYNC_FRAMES
+  async_frame frame_;
+#endif
+
+  // A link is either waiting for activation or activated, so it never needs both
+  union {
+    ActivatorType parent_activator_;
+    NextType next_continuation_;
+  };
+
+  bool activated_;
+  bool pending_ = false; // Activated, but not yet invoked
+  bool charged_ = false;  // Accounted for in the memory quota of the context
+#ifdef MINICOROS_BROKEN_PROMISE_ERROR
+  mutable bool copied_ = false; // Another copy of the promise exists or existed, see the copy-ctor
+#endif
+};
+
+/// Sink of an evaluated chain that has a context. The links of a chain only borrow its state (context and
+/// `async_local` values), so that adding a stage doesn't touch the reference count. This sink holds the reference
+/// instead: every pending link owns it (directly or through the links after it), so the state lives until the chain
+/// has resolved or been dropped.
+template<typename T>
+struct state_owning_sink {
+  continuation<T> sink;
+  MINICOROS_STD::shared_ptr<chain_state> state;
+
+  void operator()(T&& value) {
+    sink(MINICOROS_STD::move(value));
+  }
+};
+
+#ifdef MINICOROS_BROKEN_PROMISE_ERROR
+/// Wraps the sink of an evaluated chain, so that a promise that's dropped before it's invoked is reported even when
+/// the sink is handed straight to the activator of a chain without links.
+/// It also ignores a second invocation. Chains without links are only guarded against that here: in other builds
+/// their activator invokes the sink directly, see `mc::promise`.
+template<typename T>
+class guarded_sink {
+public:
+  explicit guarded_sink(continuation<T>&& sink) : sink_(MINICOROS_STD::move(sink)), pending_(true) {}
+
+  guarded_sink(guarded_sink&& other) : sink_(MINICOROS_STD::move(other.sink_)), pending_(other.pending_), copied_(other.copied_) {
+    other.pending_ = false;
+  }
+
+  // NOTE: like a copied `chain_link`, the copy is a full copy that resolves its own copy of the sink.
+  guarded_sink(const guarded_sink& other) : sink_(other.sink_), pending_(other.pending_), copied_(true) {
+    other.copied_ = true;
+  }
+
+  ~guarded_sink() {
+    if (pending_ && !copied_)
+      (*this)(broken_promise_result<T>::make());
+  }
+
+  void operator()(T&& value) {
+    assert(pending_ && "promise invoked more than once");
+
+    if (!pending_)
+      return;
+
+    pending_ = false;
+    sink_(MINICOROS_STD::move(value)); // In place, the sink may own the context of the running stage
+  }
+
+private:
+  continuation<T> sink_;
+  bool pending_;
+  mutable bool copied_ = false;
+};
+#endif
+
+} // detail
+
 /// The continuation chain monad, implements a lazy/async (based on promises) evaluation model and
 /// is the core component that this library is built around.
 /// Works by creating a chain of "activators" (promise of promises) that gets evaluated bottom-up.
@@ -62,6 +355,7 @@ class continuation_chain
 public:
   continuation_chain(continuation<continuation<T>>&& fun);
   continuation_chain(continuation_chain<T>&& other);
+  continuation_chain<T>& operator =(continuation_chain<T>&& other);
 
   // NOTE: this copy-ctor is needed because std::function requires the lambda to be copy-constructible.
   //       We don't really copy any functions containing continuation_chains, so when we have support for
@@ -73,10 +367,14 @@ public:
 
   /// Appends a functor to the chain, leading to a new chain tail
   template<typename ResultType, typename TransformType /* functor<T, ResultType> */>
-  continuation_chain<ResultType> transform(TransformType&& transformation) &&;
+  continuation_chain<ResultType> transform(TransformType&& transformation MINICOROS_ASYNC_LOCATION_PARAM) &&;
 
   void evaluate_into(continuation<T>&& sink) &&;
 
+  /// Evaluates a chain that a stage returns as the rest of the stage's own chain. Unless it was created in another
+  /// context, the chain then shares the state of the stage's chain instead of creating its own, see `mc::async_local`.
+  void evaluate_as_continuation_into(continuation<T>&& sink) &&;
+
   bool evaluated() const {
     return !activator_;
   }
@@ -85,44 +383,101 @@ public:
     activator_ = {};
   }
 
+  /// The context captured when the chain was created, see `mc::context`.
+  context* get_context() const {
+    return context_.get();
+  }
+
 private:
+  using state_ptr = MINICOROS_STD::shared_ptr<detail::chain_state>;
+
+  continuation_chain(continuation<continuation<T>>&& fun, context_ptr&& ctx, detail::locals_ptr&& locals);
+
+  void evaluate_in_state_into(detail::chain_state* state, continuation<T>&& sink);
+
+  template<typename>
+  friend class continuation_chain;
+
+  context_ptr context_; // Declared first, the links in the activator borrow it
+  detail::locals_ptr locals_;
   continuation<continuation<T>> activator_;
 };
 
 template<typename T>
-continuation_chain<T>::continuation_chain(continuation<continuation<T>>&& fun) : activator_(MINICOROS_STD::move(fun)) {}
+continuation_chain<T>::continuation_chain(continuation<continuation<T>>&& fun)
+  : context_(detail::capture_context()), locals_(detail::capture_locals()), activator_(MINICOROS_STD::move(fun)) {}
+
+template<typename T>
+continuation_chain<T>::continuation_chain(continuation<continuation<T>>&& fun, context_ptr&& ctx, detail::locals_ptr&& locals)
+  : context_(MINICOROS_STD::move(ctx)), locals_(MINICOROS_STD::move(locals)), activator_(MINICOROS_STD::move(fun)) {}
+
+template<typename T>
+continuation_chain<T>::continuation_chain(continuation_chain<T>&& other)
+  : context_(MINICOROS_STD::move(other.context_)), locals_(MINICOROS_STD::move(other.locals_)) {
+  activator_.swap(other.activator_);
+}
 
 template<typename T>
-continuation_chain<T>::continuation_chain(continuation_chain<T>&& other) { activator_.swap(other.activator_); }
+continuation_chain<T>& continuation_chain<T>::operator =(continuation_chain<T>&& other) {
+  assert((evaluated() || this == &other) && "assigning to a continuation chain that hasn't been evaluated drops it");
+  activator_ = MINICOROS_STD::move(other.activator_);
+  other.activator_ = {};
+  context_ = MINICOROS_STD::move(other.context_);
+  locals_ = MINICOROS_STD::move(other.locals_);
+  return *this;
+}
 
 template<typename T>
 template<typename ResultType, typename TransformType>
-continuation_chain<ResultType> continuation_chain<T>::transform(TransformType&& transformation) && {
-  return continuation_chain<ResultType>{
-    [
-      transformation = MINICOROS_STD::forward<TransformType>(transformation),
-      parent_activator = MINICOROS_STD::move(activator_)
-    ]
-    (continuation<ResultType>&& next_continuation) mutable {
-      parent_activator(
-        [
-          next_continuation = MINICOROS_STD::move(next_continuation),
-          transformation = MINICOROS_STD::forward<TransformType>(transformation)
-        ]
-        (T&& input) mutable {
-          // This gets invoked through the continuation; it's the part of the evaluation flow that actually calls the code and binds it with a continuation
-          // that evaluates the next functor of the chain.
-          transformation(MINICOROS_STD::move(input), MINICOROS_STD::move(next_continuation));
-        }
-      );
-    }
-  };
+continuation_chain<ResultType> continuation_chain<T>::transform(TransformType&& transformation MINICOROS_ASYNC_LOCATION_DEFINITION_PARAM) && {
+  using LinkType = detail::chain_link<T, ResultType, MINICOROS_STD::decay_t<TransformType>>;
+#ifdef MINICOROS_ENABLE_ASYNC_FRAMES
+  LinkType link{MINICOROS_STD::forward<TransformType>(transformation), MINICOROS_STD::move(activator_), context_.get()};
+  link.set_frame(location);
+  return continuation_chain<ResultType>{MINICOROS_STD::move(link), MINICOROS_STD::move(context_), MINICOROS_STD::move(locals_)};
+#else
+  return continuation_chain<ResultType>{LinkType{MINICOROS_STD::forward<TransformType>(transformation), MINICOROS_STD::move(activator_), context_.get()}, MINICOROS_STD::move(context_), MINICOROS_STD::move(locals_)};
+#endif
 }
 
 template<typename T>
 void continuation_chain<T>::evaluate_into(continuation<T>&& sink) && {
+  if (!context_) {
+    evaluate_in_state_into(nullptr, MINICOROS_STD::move(sink));
+    return;
+  }
+
+  // The chain gets its own state, so that the values it sets aren't seen by whoever created or evaluates it. One
+  // reference per evaluated chain, rather than one per link; the local one outlives the guard in the evaluation.
+  state_ptr state = MINICOROS_STD::make_shared<detail::chain_state>(detail::chain_state{MINICOROS_STD::move(context_), MINICOROS_STD::move(locals_)});
+  evaluate_in_state_into(state.get(), detail::state_owning_sink<T>{MINICOROS_STD::move(sink), state_ptr{state}});
+}
+
+template<typename T>
+void continuation_chain<T>::evaluate_as_continuation_into(continuation<T>&& sink) && {
+  detail::chain_state* running = detail::current_chain_state_slot();
+
+  // The sink is the rest of the running chain, which already owns the state
+  if (running && running->ctx == context_)
+    evaluate_in_state_into(running, MINICOROS_STD::move(sink));
+  else
+    MINICOROS_STD::move(*this).evaluate_into(MINICOROS_STD::move(sink));
+}
+
+template<typename T>
+void continuation_chain<T>::evaluate_in_state_into(detail::chain_state* state, continuation<T>&& sink) {
   assert(activator_ && "trying to evaluate using a non-set activator");
+  detail::context_guard guard{state};
+
+#ifdef MINICOROS_BROKEN_PROMISE_ERROR
+  if constexpr (detail::broken_promise_result<T>::supported)
+    activator_(detail::guarded_sink<T>{MINICOROS_STD::move(sink)});
+  else
+    activator_(MINICOROS_STD::move(sink));
+#else
   activator_(MINICOROS_STD::move(sink));
+#endif
+
   activator_ = {};
 }
 
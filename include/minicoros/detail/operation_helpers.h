@@ -15,16 +15,29 @@
   #include <eastl/utility.h>
   #include <eastl/vector.h>
   #include <eastl/optional.h>
+  #include <eastl/variant.h>
   #include <eastl/shared_ptr.h>
+  #include <eastl/fixed_vector.h>
 
   #ifndef MINICOROS_STD
     #define MINICOROS_STD eastl
   #endif
+
+  /// Number of chains that combinators (`when_all` etc) store inline before they overflow to the heap
+  #ifndef MINICOROS_EASTL_FIXED_VECTOR_SIZE
+    #define MINICOROS_EASTL_FIXED_VECTOR_SIZE 4
+  #endif
+
+  /// Allocator used for the shared state of combinators and for overflowing combinator storage
+  #ifndef MINICOROS_EASTL_ALLOCATOR
+    #define MINICOROS_EASTL_ALLOCATOR EASTLAllocatorType
+  #endif
 #else
   #include <tuple>
   #include <utility>
   #include <vector>
   #include <optional>
+  #include <variant>
   #include <memory>
 
   #ifndef MINICOROS_STD
@@ -34,6 +47,60 @@
 
 namespace mc::detail {
 
+/// Storage for the chains handed to combinators. Fan-outs are usually small, so EASTL builds keep them inline.
+#ifdef MINICOROS_USE_EASTL
+template<typename T>
+using small_vector = eastl::fixed_vector<T, MINICOROS_EASTL_FIXED_VECTOR_SIZE, true, MINICOROS_EASTL_ALLOCATOR>;
+#else
+template<typename T>
+using small_vector = std::vector<T>;
+#endif
+
+/// Allocates the state that combinators share between their chains. Non-EASTL builds can define
+/// `MINICOROS_SHARED_STATE_ALLOCATOR` as an allocator template (eg, `mc::pool_allocator`) to allocate it from.
+template<typename T, typename... Args>
+MINICOROS_STD::shared_ptr<T> make_shared_state(Args&&... args) {
+#ifdef MINICOROS_USE_EASTL
+  return eastl::allocate_shared<T>(MINICOROS_EASTL_ALLOCATOR(EASTL_NAME_VAL("minicoros")), MINICOROS_STD::forward<Args>(args)...);
+#elif defined(MINICOROS_SHARED_STATE_ALLOCATOR)
+  return std::allocate_shared<T>(MINICOROS_SHARED_STATE_ALLOCATOR<T>{}, MINICOROS_STD::forward<Args>(args)...);
+#else
+  return std::make_shared<T>(MINICOROS_STD::forward<Args>(args)...);
+#endif
+}
+
+/// Combinator state that keeps its fan-out charged to the memory quota of the context until it's released.
+template<typename StateType>
+class quota_charged : public StateType {
+public:
+  template<typename... Args>
+  quota_charged(memory_reservation&& reservation, Args&&... args)
+    : StateType(MINICOROS_STD::forward<Args>(args)...), reservation_(MINICOROS_STD::move(reservation)) {}
+
+private:
+  memory_reservation reservation_;
+};
+
+/// Allocates the shared state of a combinator that fans out to many chains, charging the state and `fan_out_bytes`
+/// to the memory quota of the current context. If that doesn't fit, the promise is failed with the quota error and
+/// null is returned; the combinator must not start any chains then.
+template<typename StateType, typename ResultType, typename... Args>
+MINICOROS_STD::shared_ptr<StateType> make_fan_out_state(size_t fan_out_bytes, promise<ResultType>&& p, Args&&... args) {
+  memory_reservation reservation{sizeof(StateType) + fan_out_bytes};
+
+  if (reservation.rejected()) {
+    MINICOROS_RECORD_EVENT(flight_event::failure, current_context());
+    MINICOROS_ERROR_TYPE error{current_context()->expiry_error()};
+    p(failure{MINICOROS_STD::move(error)});
+    return {};
+  }
+
+  if (!reservation)
+    return make_shared_state<StateType>(MINICOROS_STD::move(p), MINICOROS_STD::forward<Args>(args)...);
+
+  return make_shared_state<quota_charged<StateType>>(MINICOROS_STD::move(reservation), MINICOROS_STD::move(p), MINICOROS_STD::forward<Args>(args)...);
+}
+
 template<typename T>
 MINICOROS_STD::tuple<MINICOROS_STD::remove_reference_t<T>> convert_to_tuple(T&& value) {
   return MINICOROS_STD::tuple<T>(MINICOROS_STD::move(value));
@@ -79,6 +146,7 @@ private:
     if (!promise_)
       return;
 
+    MINICOROS_RECORD_EVENT(flight_event::combinator_joined, this);
     auto promise = MINICOROS_STD::move(promise_);
     promise_ = {};
     promise(MINICOROS_STD::move(value));
@@ -121,6 +189,7 @@ private:
     if (!promise_)
       return;
 
+    MINICOROS_RECORD_EVENT(flight_event::combinator_joined, this);
     auto promise = MINICOROS_STD::move(promise_);
     promise_ = {};
     promise(MINICOROS_STD::move(value));
@@ -131,6 +200,45 @@ private:
   promise<void> promise_;
 };
 
+/// Collects the results of all chains, including failures, until either every chain has finished or `expire` is
+/// called. Chains that haven't finished by then are left empty and their late results are dropped.
+template<typename T>
+class settled_vector_result {
+public:
+  using value_type = MINICOROS_STD::vector<MINICOROS_STD::optional<concrete_result<T>>>;
+
+  settled_vector_result(promise<value_type>&& p) : promise_(MINICOROS_STD::move(p)) {}
+
+  void resize(size_t new_size) {
+    values_.resize(new_size);
+  }
+
+  void assign(size_t index, concrete_result<T>&& result) {
+    if (!promise_)
+      return;
+
+    values_[index].emplace(MINICOROS_STD::move(result));
+
+    if (++num_finished_futures_ == values_.size())
+      expire();
+  }
+
+  void expire() {
+    if (!promise_)
+      return;
+
+    MINICOROS_RECORD_EVENT(flight_event::combinator_joined, this);
+    auto promise = MINICOROS_STD::move(promise_);
+    promise_ = {};
+    promise(MINICOROS_STD::move(values_));
+  }
+
+private:
+  value_type values_;
+  size_t num_finished_futures_ = 0;
+  promise<value_type> promise_;
+};
+
 template<typename LHS, typename RHS>
 class tuple_result {
 public:
@@ -168,6 +276,7 @@ private:
     if (!promise_)
       return;
 
+    MINICOROS_RECORD_EVENT(flight_event::combinator_joined, this);
     auto promise = MINICOROS_STD::move(promise_);
     promise_ = {};
     promise(MINICOROS_STD::move(value));
@@ -215,6 +324,7 @@ private:
     if (!promise_)
       return;
 
+    MINICOROS_RECORD_EVENT(flight_event::combinator_joined, this);
     auto promise = MINICOROS_STD::move(promise_);
     promise_ = {};
     promise(MINICOROS_STD::move(value));
@@ -262,6 +372,7 @@ private:
     if (!promise_)
       return;
 
+    MINICOROS_RECORD_EVENT(flight_event::combinator_joined, this);
     auto promise = MINICOROS_STD::move(promise_);
     promise_ = {};
     promise(MINICOROS_STD::move(value));
@@ -309,6 +420,7 @@ private:
     if (!promise_)
       return;
 
+    MINICOROS_RECORD_EVENT(flight_event::combinator_joined, this);
     auto promise = MINICOROS_STD::move(promise_);
     promise_ = {};
     promise(MINICOROS_STD::move(value));
@@ -331,6 +443,7 @@ public:
     if (!promise_)
       return;
 
+    MINICOROS_RECORD_EVENT(flight_event::combinator_joined, this);
     auto promise = MINICOROS_STD::move(promise_);
     promise_ = {};
     promise(MINICOROS_STD::move(result));
@@ -340,13 +453,93 @@ private:
   promise<T> promise_;
 };
 
+/// Maps the type of a future to the alternative it occupies in the variant returned by heterogeneous `when_any`.
+template<typename T>
+struct variant_alternative {
+  using type = T;
+};
+
+template<>
+struct variant_alternative<void> {
+  using type = MINICOROS_STD::monostate;
+};
+
+template<typename T>
+using variant_alternative_t = typename variant_alternative<T>::type;
+
+/// Like `any_result`, but for futures of different types. The winner's value is stored at its own index in the
+/// variant, so futures with the same type can still be told apart.
+template<typename VariantType>
+class any_variant_result {
+public:
+  using value_type = VariantType;
+
+  any_variant_result(promise<VariantType>&& promise) : promise_(MINICOROS_STD::move(promise)) {}
+
+  /// First invocation resolves the promise
+  template<size_t Index, typename T>
+  void assign(concrete_result<T>&& result) {
+    if (!promise_)
+      return;
+
+    MINICOROS_RECORD_EVENT(flight_event::combinator_joined, this);
+    auto promise = MINICOROS_STD::move(promise_);
+    promise_ = {};
+
+    if (!result.success()) {
+      promise(concrete_result<VariantType>{MINICOROS_STD::move(*result.get_failure())});
+      return;
+    }
+
+    if constexpr (MINICOROS_STD::is_same_v<T, void>)
+      promise(VariantType{MINICOROS_STD::in_place_index<Index>});
+    else
+      promise(VariantType{MINICOROS_STD::in_place_index<Index>, MINICOROS_STD::move(*result.get_value())});
+  }
+
+private:
+  promise<VariantType> promise_;
+};
+
+/// Buffers the result of a chain that was started before anything was attached to it. Whichever of the result and
+/// the promise arrives last completes the hand-over.
+template<typename T>
+class spawned_result {
+public:
+  void assign(concrete_result<T>&& result) {
+    if (!promise_) {
+      result_.emplace(MINICOROS_STD::move(result));
+      return;
+    }
+
+    auto promise = MINICOROS_STD::move(promise_);
+    promise_ = {};
+    promise(MINICOROS_STD::move(result));
+  }
+
+  void attach(promise<T>&& p) {
+    if (!result_) {
+      promise_ = MINICOROS_STD::move(p);
+      return;
+    }
+
+    concrete_result<T> result{MINICOROS_STD::move(*result_)};
+    result_.reset();
+    p(MINICOROS_STD::move(result));
+  }
+
+private:
+  MINICOROS_STD::optional<concrete_result<T>> result_;
+  promise<T> promise_;
+};
+
 template<typename T>
 class seq_submitter : public MINICOROS_STD::enable_shared_from_this<seq_submitter<T>> {
   using ResultingType = typename vector_result<T>::value_type;
   using ChainType = continuation_chain<concrete_result<T>>;
 
 public:
-  seq_submitter(promise<ResultingType>&& p, MINICOROS_STD::vector<ChainType>&& chains) : storage_(MINICOROS_STD::move(p)), chains_(MINICOROS_STD::move(chains)) {}
+  seq_submitter(promise<ResultingType>&& p, small_vector<ChainType>&& chains) : storage_(MINICOROS_STD::move(p)), chains_(MINICOROS_STD::move(chains)) {}
 
   void evaluate() {
     storage_.resize(chains_.size());
@@ -372,7 +565,7 @@ private:
   }
 
   vector_result<T> storage_;
-  MINICOROS_STD::vector<ChainType> chains_;
+  small_vector<ChainType> chains_;
   size_t next_chain_idx_ = 0u;
 };
 
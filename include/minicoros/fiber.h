@@ -0,0 +1,404 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_FIBER_H_
+#define MINICOROS_FIBER_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+#include <minicoros/future.h>
+#include <minicoros/context.h>
+
+#ifdef MINICOROS_USE_EASTL
+  #include <eastl/atomic.h>
+  #include <eastl/optional.h>
+  #include <eastl/utility.h>
+  #include <eastl/vector.h>
+  #include <stdint.h>
+  #include <cassert>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD eastl
+  #endif
+#else
+  #include <atomic>
+  #include <optional>
+  #include <utility>
+  #include <vector>
+  #include <cstdint>
+  #include <cassert>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD std
+  #endif
+#endif
+
+#include <mutex>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/// Usable stack size of a fiber in bytes (excluding the guard page). Stacks are reserved with `mmap`, so only the
+/// pages that a fiber actually touches are backed by memory.
+///
+/// Each stack takes two memory mappings (the stack and its guard page), whether it's mapped on its own or carved out
+/// of a larger mapping, since the kernel can't merge mappings with different protections. That makes
+/// `vm.max_map_count` (65530 by default on Linux) the practical limit on the number of live fibers, around 32k per
+/// process minus whatever else is mapped. Raise the limit, or see `MINICOROS_FIBER_UNGUARDED_STACKS`, for more.
+#ifndef MINICOROS_FIBER_STACK_SIZE
+  #define MINICOROS_FIBER_STACK_SIZE (64 * 1024)
+#endif
+
+/// Define `MINICOROS_FIBER_UNGUARDED_STACKS` to carve stacks without guard pages out of shared mappings of
+/// `MINICOROS_FIBER_STACKS_PER_SLAB` stacks each. The number of fibers is then only limited by address space and
+/// memory, which is what it takes for millions of parked fibers, but a fiber that overflows its stack silently
+/// corrupts its neighbour's. Slabs are never unmapped; the pages of unused stacks are handed back to the system.
+#ifndef MINICOROS_FIBER_STACKS_PER_SLAB
+  #define MINICOROS_FIBER_STACKS_PER_SLAB 256
+#endif
+
+/// Maximum number of unused stacks that each thread keeps around for reuse
+#ifndef MINICOROS_FIBER_STACK_POOL_SIZE
+  #define MINICOROS_FIBER_STACK_POOL_SIZE 64
+#endif
+
+namespace mc {
+
+namespace detail {
+
+struct fiber_stack {
+  void* base = nullptr;  // Start of the stack, the guard page (if any) is at the bottom. Null if the mapping failed.
+  size_t size = 0;       // Including the guard page
+  size_t guard_size = 0;
+};
+
+inline size_t round_to_pages(size_t size) {
+  const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return (size + page_size - 1) / page_size * page_size;
+}
+
+#ifdef MINICOROS_FIBER_UNGUARDED_STACKS
+/// Process-wide source of unguarded stacks. Carves them out of slab mappings, and takes back the stacks that threads
+/// don't keep around, so that they can be reused by any thread.
+class fiber_stack_slabs {
+public:
+  static fiber_stack_slabs& instance() {
+    static fiber_stack_slabs slabs;
+    return slabs;
+  }
+
+  /// Returns a stack with a null base if no stack is free and a new slab can't be mapped.
+  fiber_stack take() {
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    if (!free_stacks_.empty()) {
+      fiber_stack stack = free_stacks_.back();
+      free_stacks_.pop_back();
+      return stack;
+    }
+
+    const size_t stack_size = round_to_pages(MINICOROS_FIBER_STACK_SIZE);
+
+    if (next_stack_ == slab_end_) {
+      void* slab = mmap(nullptr, stack_size * MINICOROS_FIBER_STACKS_PER_SLAB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+      if (slab == MAP_FAILED)
+        return {};
+
+      next_stack_ = static_cast<char*>(slab);
+      slab_end_ = next_stack_ + stack_size * MINICOROS_FIBER_STACKS_PER_SLAB;
+    }
+
+    fiber_stack stack{next_stack_, stack_size, 0};
+    next_stack_ += stack_size;
+    return stack;
+  }
+
+  void give_back(fiber_stack stack) {
+    madvise(stack.base, stack.size, MADV_DONTNEED);
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    free_stacks_.push_back(stack);
+  }
+
+private:
+  std::mutex mutex_;
+  MINICOROS_STD::vector<fiber_stack> free_stacks_;
+  char* next_stack_ = nullptr;
+  char* slab_end_ = nullptr;
+};
+#endif
+
+/// Per-thread cache of fiber stacks, so that starting a fiber doesn't have to map a new stack.
+class fiber_stack_pool {
+public:
+  static fiber_stack_pool& local() {
+    thread_local fiber_stack_pool pool;
+    return pool;
+  }
+
+  ~fiber_stack_pool() {
+    for (fiber_stack& stack : free_stacks_)
+      discard(stack);
+  }
+
+  /// Returns a stack with a null base if no stack is free and a new one can't be mapped.
+  fiber_stack acquire() {
+    if (!free_stacks_.empty()) {
+      fiber_stack stack = free_stacks_.back();
+      free_stacks_.pop_back();
+      return stack;
+    }
+
+#ifdef MINICOROS_FIBER_UNGUARDED_STACKS
+    return fiber_stack_slabs::instance().take();
+#else
+    return map(MINICOROS_FIBER_STACK_SIZE);
+#endif
+  }
+
+  /// Maps a new stack with at least `usable_size` bytes above its guard page. Returns a stack with a null base if the
+  /// mapping fails, typically because the process has run out of address space or mappings (`vm.max_map_count`).
+  static fiber_stack map(size_t usable_size) {
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    if (usable_size > SIZE_MAX - 2 * page_size)
+      return {};
+
+    fiber_stack stack;
+    stack.size = round_to_pages(usable_size) + page_size;
+    stack.guard_size = page_size;
+    stack.base = mmap(nullptr, stack.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (stack.base == MAP_FAILED)
+      return {};
+
+    // Stacks grow downwards, so overflowing one hits the guard page instead of the neighbouring mapping. Protecting
+    // the page splits the mapping in two, which can fail on its own when the process is at its mapping limit.
+    if (mprotect(stack.base, page_size, PROT_NONE) != 0) {
+      munmap(stack.base, stack.size);
+      return {};
+    }
+
+    return stack;
+  }
+
+  void release(fiber_stack stack) {
+    if (free_stacks_.size() >= MINICOROS_FIBER_STACK_POOL_SIZE) {
+      discard(stack);
+      return;
+    }
+
+    free_stacks_.push_back(stack);
+  }
+
+  size_t num_free_stacks() const {
+    return free_stacks_.size();
+  }
+
+private:
+  static void discard(fiber_stack stack) {
+#ifdef MINICOROS_FIBER_UNGUARDED_STACKS
+    fiber_stack_slabs::instance().give_back(stack);
+#else
+    munmap(stack.base, stack.size);
+#endif
+  }
+
+  MINICOROS_STD::vector<fiber_stack> free_stacks_;
+};
+
+/// Handshake between `mc::await` and whoever resolves the awaited future, which may be on another thread. The fiber
+/// only counts as suspended once it has switched away, see `fiber::resume`, so the resolver never resumes a fiber
+/// that's still running.
+enum await_status : int {
+  await_pending,
+  await_suspended,
+  await_resolved,
+};
+
+using await_state = MINICOROS_STD::atomic<int>;
+
+} // detail
+
+/// A stackful coroutine for code that can't be written as `.then` chains. Inside a fiber, `mc::await` blocks on a
+/// future by suspending the fiber rather than the thread; whoever resolves the future resumes the fiber on their
+/// own stack. Parked fibers only cost their stack pages that are in use plus a small control block.
+///
+/// Fibers are POSIX only (they switch with `ucontext`). The future that a fiber awaits may be resolved on any thread.
+/// A fiber must not be resumed concurrently from two threads, and a fiber that awaits a future whose promise is
+/// dropped stays parked forever.
+class fiber {
+public:
+  using entry_type = MINICOROS_FUNCTION_TYPE<void()>;
+
+  fiber(const fiber&) = delete;
+  fiber& operator =(const fiber&) = delete;
+
+  /// Starts running `entry` on a new fiber. Returns when the fiber finishes or suspends for the first time. Returns
+  /// false, without running `entry`, if there's no stack for the fiber (see `MINICOROS_FIBER_STACK_SIZE`).
+  static bool start(entry_type&& entry) {
+    detail::fiber_stack stack = detail::fiber_stack_pool::local().acquire();
+
+    if (!stack.base)
+      return false;
+
+    fiber* f = new fiber(MINICOROS_STD::move(entry), stack);
+    f->resume();
+    return true;
+  }
+
+  /// The fiber that is running on this thread, or null if not called from within a fiber.
+  static fiber* current() {
+    return current_slot();
+  }
+
+  /// Switches back to whoever started or resumed the fiber. Must be called from within the fiber.
+  void suspend() {
+    assert(current() == this && "only the running fiber can suspend itself");
+    swapcontext(&fiber_context_, &caller_context_);
+  }
+
+  /// Switches to the fiber until it suspends or finishes. A finished fiber is destroyed.
+  void resume() {
+    fiber* previous_fiber = current_slot();
+    context* previous_context = detail::current_context_slot();
+    detail::locals_ptr* previous_locals = detail::current_locals_slot();
+    detail::chain_state* previous_state = detail::current_chain_state_slot();
+    bool finished = false;
+
+    current_slot() = this;
+
+    // A fiber that awaits is only marked as suspended from here, once it has switched away. If its future resolved
+    // in the meantime, it's switched back to right away. Once it's marked, another thread may resume it, so `this`
+    // isn't touched afterwards.
+    do {
+      detail::switch_current_context(saved_context_);
+      detail::current_locals_slot() = saved_locals_;
+      detail::current_chain_state_slot() = saved_state_;
+      swapcontext(&caller_context_, &fiber_context_);
+      saved_context_ = detail::current_context_slot();
+      saved_locals_ = detail::current_locals_slot();
+      saved_state_ = detail::current_chain_state_slot();
+      finished = finished_;
+    } while (!finished && !park());
+
+    detail::switch_current_context(previous_context);
+    detail::current_locals_slot() = previous_locals;
+    detail::current_chain_state_slot() = previous_state;
+    current_slot() = previous_fiber;
+
+    if (finished)
+      delete this;
+  }
+
+private:
+  template<typename T>
+  friend concrete_result<T> await(future<T>&& fut);
+
+  /// Suspends the fiber until `state` is resolved, see `detail::await_state`.
+  void suspend_until(detail::await_state& state) {
+    parking_ = &state;
+    suspend();
+  }
+
+  /// Marks a fiber that suspended in `suspend_until` as suspended. Returns false if it was resolved in the meantime.
+  bool park() {
+    detail::await_state* state = parking_;
+
+    if (!state)
+      return true;
+
+    parking_ = nullptr;
+    int expected = detail::await_pending;
+    return state->compare_exchange_strong(expected, detail::await_suspended, MINICOROS_STD::memory_order_acq_rel, MINICOROS_STD::memory_order_acquire);
+  }
+
+  fiber(entry_type&& entry, detail::fiber_stack stack) : entry_(MINICOROS_STD::move(entry)), stack_(stack) {
+    getcontext(&fiber_context_);
+    fiber_context_.uc_stack.ss_sp = static_cast<char*>(stack_.base) + stack_.guard_size;
+    fiber_context_.uc_stack.ss_size = stack_.size - stack_.guard_size;
+    fiber_context_.uc_link = nullptr;
+    makecontext(&fiber_context_, &fiber::trampoline, 0);
+  }
+
+  ~fiber() {
+    detail::fiber_stack_pool::local().release(stack_);
+  }
+
+  static fiber*& current_slot() {
+    thread_local fiber* current = nullptr;
+    return current;
+  }
+
+  static void trampoline() {
+    fiber* self = current_slot();
+    self->entry_();
+    self->entry_ = {};
+    self->finished_ = true;
+    swapcontext(&self->fiber_context_, &self->caller_context_);
+  }
+
+  entry_type entry_;
+  detail::fiber_stack stack_;
+  ucontext_t fiber_context_;
+  ucontext_t caller_context_;
+  context* saved_context_ = nullptr;
+  detail::locals_ptr* saved_locals_ = nullptr;
+  detail::chain_state* saved_state_ = nullptr;
+  detail::await_state* parking_ = nullptr;
+  bool finished_ = false;
+};
+
+/// Waits for the future to resolve and returns its result. Must be called from within a fiber, which is suspended
+/// until the result is available; a future that resolves synchronously doesn't suspend the fiber at all.
+///
+/// ```cpp
+/// mc::fiber::start([] {
+///   mc::concrete_result<std::string> body = mc::await(http_get(url));
+///   if (body.success())
+///     legacy_parse(*body.get_value());
+/// });
+/// ```
+template<typename T>
+concrete_result<T> await(future<T>&& fut) {
+  fiber* self = fiber::current();
+  assert(self && "mc::await can only be called from within a fiber");
+
+  MINICOROS_STD::optional<concrete_result<T>> result;
+  detail::await_state state{detail::await_pending};
+
+  MINICOROS_STD::move(fut).chain().evaluate_into([&result, &state, self] (concrete_result<T>&& value) {
+    result.emplace(MINICOROS_STD::move(value));
+
+    if (state.exchange(detail::await_resolved, MINICOROS_STD::memory_order_acq_rel) == detail::await_suspended)
+      self->resume();
+  });
+
+  if (state.load(MINICOROS_STD::memory_order_acquire) != detail::await_resolved)
+    self->suspend_until(state);
+
+  return MINICOROS_STD::move(*result);
+}
+
+/// Returns a future that, once evaluated, runs `body` on a new fiber and resolves with the result it returns.
+/// `body` returns a `concrete_result<T>` and can use `mc::await`. If the fiber can't be started, the future fails
+/// with `start_error` instead.
+template<typename T, typename CallbackType>
+future<T> run_in_fiber(CallbackType&& body, MINICOROS_ERROR_TYPE&& start_error) {
+  return future<T>([body = MINICOROS_STD::forward<CallbackType>(body), start_error = MINICOROS_STD::move(start_error)] (promise<T>&& p) mutable {
+    // The fiber runs until it first suspends before `start` returns, so it has taken the promise by then
+    bool started = fiber::start([body = MINICOROS_STD::move(body), &p] () mutable {
+      promise<T> fiber_promise = MINICOROS_STD::move(p);
+      fiber_promise(body());
+    });
+
+    if (!started)
+      p(failure{MINICOROS_STD::move(start_error)});
+  });
+}
+
+} // mc
+
+#endif // MINICOROS_FIBER_H_
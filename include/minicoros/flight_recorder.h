@@ -0,0 +1,243 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_FLIGHT_RECORDER_H_
+#define MINICOROS_FLIGHT_RECORDER_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+/// The flight recorder keeps a record of the most recent chain events of every thread, see `mc::flight_recorder`.
+/// It's always on where it's supported (POSIX), so that there's something to dump when a process wedges or crashes.
+/// Define `MINICOROS_DISABLE_FLIGHT_RECORDER` (in every translation unit) to compile recording to nothing.
+#if !defined(MINICOROS_ENABLE_FLIGHT_RECORDER) && !defined(MINICOROS_DISABLE_FLIGHT_RECORDER) && (defined(__unix__) || defined(__APPLE__))
+  #define MINICOROS_ENABLE_FLIGHT_RECORDER
+#endif
+
+#ifdef MINICOROS_ENABLE_FLIGHT_RECORDER
+
+#include <minicoros/context.h>
+
+#ifdef MINICOROS_USE_EASTL
+  #include <eastl/atomic.h>
+  #include <eastl/chrono.h>
+  #include <stdint.h>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD eastl
+  #endif
+#else
+  #include <atomic>
+  #include <chrono>
+  #include <cstdint>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD std
+  #endif
+#endif
+
+#include <signal.h>
+#include <unistd.h>
+
+/// Number of events kept per thread. Must be a power of two.
+#ifndef MINICOROS_FLIGHT_RECORDER_SIZE
+  #define MINICOROS_FLIGHT_RECORDER_SIZE 256
+#endif
+
+#define MINICOROS_RECORD_EVENT(event, object) ::mc::flight_recorder::record(event, object)
+
+namespace mc {
+
+enum class flight_event : uint8_t {
+  stage_entered,
+  promise_resolved,
+  failure,
+  enqueued,
+  combinator_joined,
+};
+
+/// Per-thread ring buffers of the last `MINICOROS_FLIGHT_RECORDER_SIZE` chain events, for finding out what the async
+/// machinery was doing when a process wedged or crashed. Recording an event is a handful of stores into a
+/// thread-local buffer. `dump` writes all threads' events to a file descriptor and is async-signal-safe:
+///
+/// ```cpp
+/// mc::flight_recorder::dump_on_signal(SIGUSR1); // `kill -USR1 <pid>` prints the events to stderr
+/// mc::flight_recorder::dump_on_crash(SIGSEGV);
+/// ```
+///
+/// Buffers of exited threads are kept so that they can still be dumped.
+class flight_recorder {
+public:
+  static_assert((MINICOROS_FLIGHT_RECORDER_SIZE & (MINICOROS_FLIGHT_RECORDER_SIZE - 1)) == 0, "MINICOROS_FLIGHT_RECORDER_SIZE must be a power of two");
+
+  struct entry {
+    uint64_t timestamp_ns;
+    const void* object;
+    uint64_t trace_id;
+    flight_event event;
+  };
+
+  static void record(flight_event event, const void* object) {
+    thread_buffer& buffer = local_buffer();
+    uint64_t index = buffer.num_events.load(MINICOROS_STD::memory_order_relaxed);
+    context* ctx = current_context();
+
+    buffer.entries[index & (MINICOROS_FLIGHT_RECORDER_SIZE - 1)] = entry{
+      static_cast<uint64_t>(MINICOROS_STD::chrono::duration_cast<MINICOROS_STD::chrono::nanoseconds>(MINICOROS_STD::chrono::steady_clock::now().time_since_epoch()).count()),
+      object,
+      ctx ? ctx->trace_id() : 0,
+      event};
+
+    buffer.num_events.store(index + 1, MINICOROS_STD::memory_order_release);
+  }
+
+  /// Writes the recorded events of all threads to `fd`, oldest first. Async-signal-safe.
+  static void dump(int fd) {
+    for (thread_buffer* buffer = buffers().load(MINICOROS_STD::memory_order_acquire); buffer; buffer = buffer->next_buffer) {
+      uint64_t end = buffer->num_events.load(MINICOROS_STD::memory_order_acquire);
+      uint64_t begin = end > MINICOROS_FLIGHT_RECORDER_SIZE ? end - MINICOROS_FLIGHT_RECORDER_SIZE : 0;
+
+      for (uint64_t i = begin; i < end; ++i) {
+        const entry& e = buffer->entries[i & (MINICOROS_FLIGHT_RECORDER_SIZE - 1)];
+        line_writer line;
+        line.append("minicoros thread=").append_decimal(buffer->thread_index);
+        line.append(" t=").append_decimal(e.timestamp_ns);
+        line.append(" ").append(event_name(e.event));
+        line.append(" object=0x").append_hex(reinterpret_cast<uintptr_t>(e.object));
+        line.append(" trace=").append_decimal(e.trace_id);
+        line.append("\n");
+        line.flush(fd);
+      }
+    }
+  }
+
+  /// Installs a handler that dumps the events to `fd` every time `signum` is raised. All handlers share one file
+  /// descriptor, the one that was installed last.
+  static void dump_on_signal(int signum, int fd = STDERR_FILENO) {
+    install_handler(signum, fd, &flight_recorder::dump_handler, 0);
+  }
+
+  /// Installs a handler that dumps the events to `fd` when `signum` is raised, and then lets the default action of
+  /// the signal (typically a core dump) run.
+  static void dump_on_crash(int signum, int fd = STDERR_FILENO) {
+    install_handler(signum, fd, &flight_recorder::crash_handler, SA_RESETHAND);
+  }
+
+  static const char* event_name(flight_event event) {
+    switch (event) {
+      case flight_event::stage_entered: return "stage_entered";
+      case flight_event::promise_resolved: return "promise_resolved";
+      case flight_event::failure: return "failure";
+      case flight_event::enqueued: return "enqueued";
+      case flight_event::combinator_joined: return "combinator_joined";
+    }
+
+    return "unknown";
+  }
+
+private:
+  struct thread_buffer {
+    entry entries[MINICOROS_FLIGHT_RECORDER_SIZE];
+    MINICOROS_STD::atomic<uint64_t> num_events{0};
+    uint64_t thread_index = 0;
+    thread_buffer* next_buffer = nullptr;
+  };
+
+  /// Formats a line on the stack, since `dump` can't allocate or use stdio.
+  class line_writer {
+  public:
+    line_writer& append(const char* text) {
+      while (*text && length_ < sizeof(buffer_))
+        buffer_[length_++] = *text++;
+
+      return *this;
+    }
+
+    line_writer& append_decimal(uint64_t value) {
+      char digits[20];
+      size_t num_digits = 0;
+
+      do {
+        digits[num_digits++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+      } while (value);
+
+      while (num_digits && length_ < sizeof(buffer_))
+        buffer_[length_++] = digits[--num_digits];
+
+      return *this;
+    }
+
+    line_writer& append_hex(uint64_t value) {
+      for (int shift = 60; shift >= 0 && length_ < sizeof(buffer_); shift -= 4)
+        buffer_[length_++] = "0123456789abcdef"[(value >> shift) & 0xf];
+
+      return *this;
+    }
+
+    void flush(int fd) {
+      ssize_t written = write(fd, buffer_, length_);
+      (void)written;
+    }
+
+  private:
+    char buffer_[160];
+    size_t length_ = 0;
+  };
+
+  static MINICOROS_STD::atomic<thread_buffer*>& buffers() {
+    static MINICOROS_STD::atomic<thread_buffer*> head{nullptr};
+    return head;
+  }
+
+  static thread_buffer& local_buffer() {
+    thread_local thread_buffer* buffer = register_buffer();
+    return *buffer;
+  }
+
+  static thread_buffer* register_buffer() {
+    static MINICOROS_STD::atomic<uint64_t> num_threads{0};
+
+    thread_buffer* buffer = new thread_buffer;
+    buffer->thread_index = num_threads.fetch_add(1, MINICOROS_STD::memory_order_relaxed);
+    buffer->next_buffer = buffers().load(MINICOROS_STD::memory_order_relaxed);
+
+    while (!buffers().compare_exchange_weak(buffer->next_buffer, buffer, MINICOROS_STD::memory_order_release, MINICOROS_STD::memory_order_relaxed)) {}
+
+    return buffer;
+  }
+
+  /// Shared by all installed handlers. Atomic, since a handler can run on any thread while another thread installs
+  /// a handler; lock-free atomics are async-signal-safe.
+  static MINICOROS_STD::atomic<int>& dump_fd() {
+    static MINICOROS_STD::atomic<int> fd{STDERR_FILENO};
+    return fd;
+  }
+
+  static void install_handler(int signum, int fd, void (*handler)(int), int flags) {
+    dump_fd().store(fd, MINICOROS_STD::memory_order_relaxed);
+
+    struct sigaction action = {};
+    action.sa_handler = handler;
+    action.sa_flags = flags;
+    sigemptyset(&action.sa_mask);
+    sigaction(signum, &action, nullptr);
+  }
+
+  static void dump_handler(int) {
+    dump(dump_fd().load(MINICOROS_STD::memory_order_relaxed));
+  }
+
+  static void crash_handler(int signum) {
+    dump(dump_fd().load(MINICOROS_STD::memory_order_relaxed));
+    raise(signum); // SA_RESETHAND restored the default action
+  }
+};
+
+} // mc
+
+#else
+  #define MINICOROS_RECORD_EVENT(event, object) ((void)0)
+#endif // MINICOROS_ENABLE_FLIGHT_RECORDER
+
+#endif // MINICOROS_FLIGHT_RECORDER_H_
@@ -69,8 +69,10 @@ struct resulting_successful_type<void> {
   using type = void;
 };
 
-template<typename LambdaType>
-auto resulting_type_from_successful_callback(LambdaType&& lambda) -> typename resulting_successful_type<decltype(return_type(MINICOROS_STD::forward<LambdaType>(lambda)))>::type;
+/// The type a `.then` callback resolves to when it's invoked with the value of a `future<T>`. The callback
+/// is invoked with the known value type rather than probed, which makes generic lambdas work.
+template<typename CallbackType, typename T>
+using resulting_type_from_successful_callback = typename resulting_successful_type<callback_result_t<CallbackType, T>>::type;
 
 
 /// Struct used to map the return type of fail handlers to a naked type that can be used in a future.
@@ -104,6 +106,29 @@ struct resulting_failure_type<mc::failure, FallbackType> {
 template<typename FallbackType, typename CallbackType>
 auto resulting_type_from_failure_callback(CallbackType&& callback) -> typename resulting_failure_type<decltype(callback(MINICOROS_STD::declval<MINICOROS_ERROR_TYPE>())), FallbackType>::type;
 
+/// Failure path of `.then` stages. It only depends on the input and output types, so it's instantiated once
+/// per type pair instead of once per callback.
+template<typename T, typename ResultType>
+void propagate_failure(concrete_result<T>&& result, promise<ResultType>&& promise) {
+  MINICOROS_RECORD_EVENT(flight_event::failure, &promise);
+  promise(MINICOROS_STD::move(*result.get_failure()));
+}
+
+/// Fails the promise if the context of the running stage has expired, see `mc::context`. Like `propagate_failure`,
+/// it's only instantiated once per type.
+template<typename ResultType>
+bool fail_if_context_expired(promise<ResultType>& promise) {
+  context* ctx = current_context();
+
+  if (!ctx || !ctx->expired())
+    return false;
+
+  MINICOROS_RECORD_EVENT(flight_event::failure, ctx);
+  MINICOROS_ERROR_TYPE error{ctx->expiry_error()};
+  promise(failure{MINICOROS_STD::move(error)});
+  return true;
+}
+
 } // detail
 
 /// Represents a lazily evaluated process which can be composed of multiple sub-processes ("callbacks") and that
@@ -145,7 +170,15 @@ public:
   future& operator =(const future&) = delete;
 
   future(future&& other) : chain_(MINICOROS_STD::move(other.chain_)) {}
-  future& operator =(future&& other) {chain_ = MINICOROS_STD::move(other.chain_); return *this; }
+  /// Like destruction, assigning to a future that hasn't been evaluated evaluates its chain first (ignoring the
+  /// result), rather than dropping it silently. `freeze` the future beforehand to drop it.
+  future& operator =(future&& other) {
+    if (this != &other && !chain_.evaluated())
+      MINICOROS_STD::move(*this).ignore_result();
+
+    chain_ = MINICOROS_STD::move(other.chain_);
+    return *this;
+  }
 
   ~future() {
     if (!chain_.evaluated())
@@ -156,10 +189,13 @@ public:
 
   /// Creates a new future by transforming this future through the given callback.
   /// The callback will be invoked with the resulting value of this future iff it's successful, otherwise
-  /// execution will propagate through to the next callback.
+  /// execution will propagate through to the next callback. If the chain's `mc::context` has expired, the callback
+  /// is skipped and the context's error is propagated instead.
   /// The callback must either return `mc::result<A>` (which transforms this future to a `future<A>`), or
   /// `void`, ie, no return statement.
-  /// The callback must accept as an argument the resulting value from this future.
+  /// The callback must accept as an argument the resulting value from this future. Tuple values are unpacked
+  /// into separate arguments and the callback may take only the leading ones. Generic lambdas (`auto` parameters)
+  /// are invoked with the value types of this future.
   ///
   /// ```cpp
   /// future<int>(...)
@@ -174,18 +210,18 @@ public:
   ///   });
   /// ```
   template<typename CallbackType>
-  auto then(CallbackType&& callback) && {
-    using ReturnType = decltype(detail::resulting_type_from_successful_callback(MINICOROS_STD::forward<CallbackType>(callback)));
+  auto then(CallbackType&& callback MINICOROS_ASYNC_LOCATION_PARAM) && {
+    using ReturnType = detail::resulting_type_from_successful_callback<CallbackType, T>;
 
     // Transform the continuation chain...
     auto new_chain = MINICOROS_STD::move(chain_).template transform<concrete_result<ReturnType>>([callback = MINICOROS_STD::forward<CallbackType>(callback)](concrete_result<T>&& result, promise<ReturnType>&& promise) mutable {
-      if (result.success()) {
-        result.resolve_promise_with_callback(MINICOROS_STD::forward<CallbackType>(callback), MINICOROS_STD::move(promise));
+      if (!result.success()) {
+        detail::propagate_failure(MINICOROS_STD::move(result), MINICOROS_STD::move(promise));
       }
-      else {
-        promise(MINICOROS_STD::move(*result.get_failure()));
+      else if (!detail::fail_if_context_expired(promise)) {
+        result.resolve_promise_with_callback(callback, MINICOROS_STD::move(promise));
       }
-    });
+    } MINICOROS_ASYNC_LOCATION_ARG);
 
     // ... and return it wrapped in a future
     return future<ReturnType>{MINICOROS_STD::move(new_chain)};
@@ -214,7 +250,7 @@ public:
   ///     });
   /// ```
   template<typename CallbackType>
-  auto fail(CallbackType&& callback) && {
+  auto fail(CallbackType&& callback MINICOROS_ASYNC_LOCATION_PARAM) && {
     using ReturnType = decltype(detail::resulting_type_from_failure_callback<T>(MINICOROS_STD::forward<CallbackType>(callback)));
     using CallbackReturnType = decltype(callback(MINICOROS_STD::declval<MINICOROS_ERROR_TYPE>()));
     using ResultType = MINICOROS_STD::conditional_t<detail::is_result_v<CallbackReturnType>, CallbackReturnType, mc::result<T>>;
@@ -226,10 +262,11 @@ public:
       }
       else {
         // We received a failure, so invoke the callback
+        MINICOROS_RECORD_EVENT(flight_event::failure, &promise);
         ResultType res{callback(MINICOROS_STD::move(result.get_failure()->error))};
         res.resolve_promise(MINICOROS_STD::move(promise));
       }
-    });
+    } MINICOROS_ASYNC_LOCATION_ARG);
 
     // ... and return it wrapped in a future
     return future<ReturnType>{MINICOROS_STD::move(new_chain)};
@@ -238,7 +275,7 @@ public:
   /// Called regardless of success or failure. A `concrete_result<T>` will be passed to
   /// the callback, and the callback is expected to return a `concrete_result<A>`.
   template<typename CallbackType>
-  auto map(CallbackType&& callback) && {
+  auto map(CallbackType&& callback MINICOROS_ASYNC_LOCATION_PARAM) && {
     using ReturnType = decltype(callback(MINICOROS_STD::declval<concrete_result<T>>()));
     static_assert(is_concrete_result_v<ReturnType>, "Callback must return concrete_result<...>");
 
@@ -246,14 +283,14 @@ public:
 
     auto new_chain = MINICOROS_STD::move(chain_).template transform<ReturnType>([callback = MINICOROS_STD::forward<CallbackType>(callback)] (concrete_result<T>&& result, promise<WrappedType>&& promise) mutable {
       promise(callback(MINICOROS_STD::move(result)));
-    });
+    } MINICOROS_ASYNC_LOCATION_ARG);
 
     return future<WrappedType>{MINICOROS_STD::move(new_chain)};
   }
 
   template<typename CallbackType>
-  auto finally(CallbackType&& callback) && {
-    return MINICOROS_STD::move(*this).map(MINICOROS_STD::forward<CallbackType>(callback));
+  auto finally(CallbackType&& callback MINICOROS_ASYNC_LOCATION_PARAM) && {
+    return MINICOROS_STD::move(*this).map(MINICOROS_STD::forward<CallbackType>(callback) MINICOROS_ASYNC_LOCATION_ARG);
   }
 
   template<typename CallbackType>
@@ -274,6 +311,7 @@ public:
   future<T> enqueue(ExecutorType&& executor) && {
     // Take the executor by copy
     return MINICOROS_STD::move(chain_).template transform<concrete_result<T>>([executor](concrete_result<T>&& value, promise<T>&& promise) mutable {
+      MINICOROS_RECORD_EVENT(flight_event::enqueued, &promise);
       executor([value = MINICOROS_STD::move(value), promise = MINICOROS_STD::move(promise)] () mutable {
         MINICOROS_STD::move(promise)(MINICOROS_STD::move(value));
       });
@@ -285,7 +323,7 @@ public:
     using ResultingTupleType = typename detail::tuple_result<T, RhsResultType>::value_type;
 
     return future<ResultingTupleType>([lhs_chain = MINICOROS_STD::move(*this).chain(), rhs_chain = MINICOROS_STD::move(rhs).chain()](promise<ResultingTupleType>&& p) mutable {
-      auto result_builder = MINICOROS_STD::make_shared<detail::tuple_result<T, RhsResultType>>(MINICOROS_STD::move(p));
+      auto result_builder = detail::make_shared_state<detail::tuple_result<T, RhsResultType>>(MINICOROS_STD::move(p));
 
       MINICOROS_STD::move(lhs_chain).evaluate_into([result_builder] (concrete_result<T>&& result) {
         result_builder->assign_lhs(MINICOROS_STD::move(result));
@@ -303,7 +341,7 @@ public:
     // Unwrap the chains from their future overcoats. Futures aren't copy-constructible, but the chains are. Remove
     // this when we have move-only std::function.
     return future<T>([lhs_chain = MINICOROS_STD::move(*this).chain(), rhs_chain = MINICOROS_STD::move(rhs).chain()](promise<T>&& p) mutable {
-      auto result_builder = MINICOROS_STD::make_shared<detail::any_result<T>>(MINICOROS_STD::move(p));
+      auto result_builder = detail::make_shared_state<detail::any_result<T>>(MINICOROS_STD::move(p));
 
       MINICOROS_STD::move(lhs_chain).evaluate_into([result_builder] (concrete_result<T>&& result) {
         result_builder->assign(MINICOROS_STD::move(result));
@@ -387,7 +425,7 @@ public:
     if (StoredType* value = MINICOROS_STD::get_if<StoredType>(&value_))
       MINICOROS_STD::move(promise)(MINICOROS_STD::move(*value));
     else if (future<type>* coro = MINICOROS_STD::get_if<future<type>>(&value_))
-      MINICOROS_STD::move(*coro).chain().evaluate_into(MINICOROS_STD::move(promise));
+      MINICOROS_STD::move(*coro).chain().evaluate_as_continuation_into(MINICOROS_STD::move(promise));
     else if (failure* f = MINICOROS_STD::get_if<failure>(&value_))
       MINICOROS_STD::move(promise)(MINICOROS_STD::move(*f));
     else
@@ -414,7 +452,7 @@ public:
     if (MINICOROS_STD::get_if<success_t>(&value_))
       MINICOROS_STD::move(promise)({});
     else if (future<void>* coro = MINICOROS_STD::get_if<future<void>>(&value_))
-      MINICOROS_STD::move(*coro).chain().evaluate_into(MINICOROS_STD::move(promise));
+      MINICOROS_STD::move(*coro).chain().evaluate_as_continuation_into(MINICOROS_STD::move(promise));
     else if (failure* f = MINICOROS_STD::get_if<failure>(&value_))
       MINICOROS_STD::move(promise)(MINICOROS_STD::move(*f));
     else
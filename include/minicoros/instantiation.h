@@ -0,0 +1,44 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_INSTANTIATION_H_
+#define MINICOROS_INSTANTIATION_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+#include <minicoros/future.h>
+
+/// Explicit instantiation support for commonly used future types. Every translation unit that uses
+/// `future<T>` otherwise instantiates the same class templates, which costs both compile and link time.
+///
+/// Declare the types in a header that is included by the users of the types:
+///
+/// ```cpp
+/// MINICOROS_DECLARE_FUTURE(void)
+/// MINICOROS_DECLARE_FUTURE(std::string)
+/// ```
+///
+/// ... and instantiate them in exactly one .cpp file:
+///
+/// ```cpp
+/// MINICOROS_INSTANTIATE_FUTURE(void)
+/// MINICOROS_INSTANTIATE_FUTURE(std::string)
+/// ```
+///
+/// Both macros must be used at global scope. Explicitly instantiating a class instantiates all of its
+/// (non-template) members, so `T` has to be default-constructible for `concrete_result<T>` to instantiate.
+/// The template member functions (`then`, `fail`, etc) are instantiated per callback as usual.
+#define MINICOROS_DECLARE_FUTURE(...) \
+  extern template class mc::concrete_result<__VA_ARGS__>; \
+  extern template class mc::continuation_chain<mc::concrete_result<__VA_ARGS__>>; \
+  extern template class mc::result<__VA_ARGS__>; \
+  extern template class mc::future<__VA_ARGS__>;
+
+#define MINICOROS_INSTANTIATE_FUTURE(...) \
+  template class mc::concrete_result<__VA_ARGS__>; \
+  template class mc::continuation_chain<mc::concrete_result<__VA_ARGS__>>; \
+  template class mc::result<__VA_ARGS__>; \
+  template class mc::future<__VA_ARGS__>;
+
+#endif // MINICOROS_INSTANTIATION_H_
@@ -0,0 +1,219 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_MICROTASK_QUEUE_H_
+#define MINICOROS_MICROTASK_QUEUE_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+#include <minicoros/continuation_chain.h>
+
+#ifdef MINICOROS_USE_EASTL
+  #include <eastl/utility.h>
+  #include <eastl/vector.h>
+  #include <stdint.h>
+  #include <cassert>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD eastl
+  #endif
+#else
+  #include <utility>
+  #include <vector>
+  #include <cstdint>
+  #include <cassert>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD std
+  #endif
+#endif
+
+namespace mc {
+
+/// Executor that batches the continuations of one event loop turn and runs them at the end of the turn, when the
+/// event loop calls `drain`. Continuations that are enqueued while draining run in the same drain, one after the
+/// other rather than nested, so long chains don't recurse deeply.
+///
+/// Components that batch work (batch loaders, write coalescers) register a turn hook. Hooks run once the queue has
+/// run empty, which is when everything that the turn could add to a batch has been added; whatever the hooks enqueue
+/// is drained before `drain` returns.
+///
+/// ```cpp
+/// mc::microtask_queue microtasks;
+/// microtasks.add_turn_hook([&writer] { writer.flush(); });
+///
+/// while (loop.run_once()) // Handlers call .enqueue(microtasks.executor())
+///   microtasks.drain();
+/// ```
+///
+/// Not thread-safe; a queue belongs to the thread of its event loop.
+class microtask_queue {
+public:
+  using task_type = MINICOROS_FUNCTION_TYPE<void()>;
+  using hook_type = MINICOROS_FUNCTION_TYPE<void()>;
+  using hook_id = size_t;
+
+  /// Copyable handle to the queue, for `future::enqueue` (which takes its executor by copy).
+  class executor_type {
+  public:
+    explicit executor_type(microtask_queue& queue) : queue_(&queue) {}
+
+    void operator()(task_type&& task) const {
+      queue_->enqueue(MINICOROS_STD::move(task));
+    }
+
+  private:
+    microtask_queue* queue_;
+  };
+
+  /// `drain_threshold` bounds the number of pending tasks: enqueueing beyond it drains the queue right away instead
+  /// of waiting for the end of the turn.
+  explicit microtask_queue(size_t drain_threshold = SIZE_MAX) : drain_threshold_(drain_threshold) {}
+
+  microtask_queue(const microtask_queue&) = delete;
+  microtask_queue& operator =(const microtask_queue&) = delete;
+
+  ~microtask_queue() {
+    assert(!draining_ && "microtask_queue destroyed while draining");
+  }
+
+  executor_type executor() {
+    return executor_type{*this};
+  }
+
+  void enqueue(task_type&& task) {
+    pending_tasks_.push_back(MINICOROS_STD::move(task));
+
+    if (!draining_ && pending_tasks_.size() >= drain_threshold_)
+      drain();
+  }
+
+  /// Ends the turn: runs the pending tasks and the turn hooks until no tasks are left. Reentrant calls (from a task or
+  /// hook) return immediately, the outer drain picks up their work.
+  void drain() {
+    if (draining_)
+      return;
+
+    draining_ = true;
+
+    do {
+      run_pending_tasks();
+      run_hooks();
+    } while (!pending_tasks_.empty());
+
+    draining_ = false;
+    ++num_turns_;
+  }
+
+  /// Registers a function to run at the end of every turn. A hook that always enqueues a task makes `drain` loop
+  /// forever. Hooks that are added by a hook first run in the next round of hooks.
+  hook_id add_turn_hook(hook_type&& hook) {
+    (running_hooks_ ? added_hooks_ : hooks_).push_back(hook_entry{next_hook_id_, MINICOROS_STD::move(hook)});
+    return next_hook_id_++;
+  }
+
+  /// Unregisters a hook. Hooks may remove themselves or each other while they run.
+  void remove_turn_hook(hook_id id) {
+    if (erase_hook(added_hooks_, id))
+      return;
+
+    // The hooks are being iterated over, so only mark the hook; it's erased once they've all run
+    if (running_hooks_) {
+      for (hook_entry& entry : hooks_) {
+        if (entry.id == id)
+          entry.removed = true;
+      }
+
+      return;
+    }
+
+    erase_hook(hooks_, id);
+  }
+
+  size_t num_pending_tasks() const {
+    return pending_tasks_.size();
+  }
+
+  /// Number of completed drains
+  size_t num_turns() const {
+    return num_turns_;
+  }
+
+private:
+  struct hook_entry {
+    hook_id id;
+    hook_type hook;
+    bool removed = false;
+  };
+
+  static bool erase_hook(MINICOROS_STD::vector<hook_entry>& hooks, hook_id id) {
+    for (size_t i = 0; i < hooks.size(); ++i) {
+      if (hooks[i].id == id) {
+        hooks.erase(hooks.begin() + i);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  /// Runs the hooks in place. Hooks that are removed meanwhile are skipped and erased afterwards, and hooks that are
+  /// added meanwhile are appended afterwards, so that the iteration is never disturbed.
+  void run_hooks() {
+    running_hooks_ = true;
+
+    for (size_t i = 0; i < hooks_.size(); ++i) {
+      if (!hooks_[i].removed)
+        hooks_[i].hook();
+    }
+
+    running_hooks_ = false;
+
+    size_t num_kept = 0;
+
+    for (size_t i = 0; i < hooks_.size(); ++i) {
+      if (hooks_[i].removed)
+        continue;
+
+      if (num_kept != i)
+        hooks_[num_kept] = MINICOROS_STD::move(hooks_[i]);
+
+      ++num_kept;
+    }
+
+    hooks_.resize(num_kept);
+
+    for (hook_entry& entry : added_hooks_)
+      hooks_.push_back(MINICOROS_STD::move(entry));
+
+    added_hooks_.clear();
+  }
+
+  void run_pending_tasks() {
+    // Run the tasks from a second vector so that enqueueing doesn't invalidate the iteration. Both keep their
+    // capacity, so a warmed-up queue doesn't allocate.
+    while (!pending_tasks_.empty()) {
+      MINICOROS_STD::swap(pending_tasks_, running_tasks_);
+
+      for (task_type& task : running_tasks_)
+        task();
+
+      running_tasks_.clear();
+    }
+  }
+
+  MINICOROS_STD::vector<task_type> pending_tasks_;
+  MINICOROS_STD::vector<task_type> running_tasks_;
+  MINICOROS_STD::vector<hook_entry> hooks_;
+  MINICOROS_STD::vector<hook_entry> added_hooks_;
+  size_t drain_threshold_;
+  hook_id next_hook_id_ = 0;
+  size_t num_turns_ = 0;
+  bool draining_ = false;
+  bool running_hooks_ = false;
+};
+
+} // mc
+
+#endif // MINICOROS_MICROTASK_QUEUE_H_
@@ -0,0 +1,54 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_MINICOROS_H_
+#define MINICOROS_MINICOROS_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+/// Umbrella header. Define `MINICOROS_USE_MODULES` to import the prebuilt `minicoros` module
+/// (see `modules/minicoros.cppm`) instead of parsing the headers.
+#ifdef MINICOROS_USE_MODULES
+#include <type_traits>
+
+import minicoros;
+
+#ifdef MINICOROS_USE_EASTL
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD eastl
+  #endif
+#else
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD std
+  #endif
+#endif
+
+#ifndef MINICOROS_ERROR_TYPE
+  #define MINICOROS_ERROR_TYPE int
+#endif
+
+#ifdef MINICOROS_USE_EASTL
+static_assert(mc::config::uses_eastl, "the minicoros module was built without MINICOROS_USE_EASTL");
+#else
+static_assert(!mc::config::uses_eastl, "the minicoros module was built with MINICOROS_USE_EASTL");
+#endif
+
+static_assert(std::is_same_v<mc::config::error_type, MINICOROS_ERROR_TYPE>, "the minicoros module was built with a different MINICOROS_ERROR_TYPE");
+#else
+  #include <minicoros/future.h>
+  #include <minicoros/operations.h>
+  #include <minicoros/task_scope.h>
+  #include <minicoros/promise_pair.h>
+  #include <minicoros/microtask_queue.h>
+  #include <minicoros/task_graph.h>
+  #include <minicoros/async_memo.h>
+  #include <minicoros/rate_limiter.h>
+  #include <minicoros/pool.h>
+
+  #if defined(__unix__) || defined(__APPLE__)
+    #include <minicoros/fiber.h>
+  #endif
+#endif
+
+#endif // MINICOROS_MINICOROS_H_
@@ -13,6 +13,8 @@
 #ifdef MINICOROS_USE_EASTL
   #include <eastl/vector.h>
   #include <eastl/tuple.h>
+  #include <eastl/utility.h>
+  #include <eastl/variant.h>
   #include <eastl/memory.h>
   #include <eastl/shared_ptr.h>
 
@@ -22,6 +24,8 @@
 #else
   #include <vector>
   #include <tuple>
+  #include <utility>
+  #include <variant>
   #include <memory>
 
   #ifndef MINICOROS_STD
@@ -36,8 +40,8 @@ namespace detail {
 /// Unwrap the chains from their future overcoats. Futures aren't copy-constructible, but the chains are. Remove
 /// this when we have move-only std::function.
 template<typename T>
-MINICOROS_STD::vector<continuation_chain<concrete_result<T>>> unwrap_chains(MINICOROS_STD::vector<future<T>>&& futures) {
-  MINICOROS_STD::vector<continuation_chain<concrete_result<T>>> chains;
+small_vector<continuation_chain<concrete_result<T>>> unwrap_chains(MINICOROS_STD::vector<future<T>>&& futures) {
+  small_vector<continuation_chain<concrete_result<T>>> chains;
   chains.reserve(futures.size());
 
   for (future<T>& fut : futures)
@@ -46,6 +50,24 @@ MINICOROS_STD::vector<continuation_chain<concrete_result<T>>> unwrap_chains(MINI
   return chains;
 }
 
+/// Memory that a combinator allocates for each of its chains: the slot for its result and the continuation that
+/// reports into the shared state. Charged to the memory quota of the context up front, see `make_fan_out_state`.
+template<typename T, typename SlotType>
+constexpr size_t fan_out_bytes_per_chain() {
+  if constexpr (MINICOROS_STD::is_void_v<SlotType>)
+    return sizeof(continuation<concrete_result<T>>);
+  else
+    return sizeof(SlotType) + sizeof(continuation<concrete_result<T>>);
+}
+
+/// Starts all chains of a heterogeneous `when_any`, each reporting into the shared state with its own index.
+template<typename ChainTuple, typename ResultBuilderType, size_t... Indices>
+void evaluate_into_any(ChainTuple&& chains, const MINICOROS_STD::shared_ptr<ResultBuilderType>& result_builder, MINICOROS_STD::index_sequence<Indices...>) {
+  (MINICOROS_STD::move(MINICOROS_STD::get<Indices>(chains)).evaluate_into([result_builder] (auto&& result) {
+    result_builder->template assign<Indices>(MINICOROS_STD::move(result));
+  }), ...);
+}
+
 } // detail
 
 template<typename T>
@@ -59,7 +81,10 @@ auto when_all(MINICOROS_STD::vector<future<T>>&& futures) {
       return;
     }
 
-    auto result_builder = MINICOROS_STD::make_shared<detail::vector_result<T>>(MINICOROS_STD::move(p));
+    auto result_builder = detail::make_fan_out_state<detail::vector_result<T>>(chains.size() * detail::fan_out_bytes_per_chain<T, T>(), MINICOROS_STD::move(p));
+    if (!result_builder)
+      return;
+
     result_builder->resize(static_cast<int>(chains.size()));
 
     for (size_t i = 0; i < chains.size(); ++i) {
@@ -70,6 +95,50 @@ auto when_all(MINICOROS_STD::vector<future<T>>&& futures) {
   });
 }
 
+/// Gathers the results of the futures under a latency budget. The returned future resolves when all futures have
+/// finished or when `deadline` resolves, whichever happens first, with one entry per future: its result (success or
+/// failure) or an empty optional if it hadn't finished by the deadline. Stragglers aren't waited for and their
+/// results are dropped.
+/// `deadline` is typically a timer: a `future<void>` that resolves after the budget has elapsed.
+///
+/// ```cpp
+/// mc::when_all_until(std::move(shard_requests), timer.after(50ms))
+///   .then([] (std::vector<std::optional<mc::concrete_result<page>>> pages) {
+///     // Render whatever made it in time
+///   });
+/// ```
+template<typename T>
+auto when_all_until(MINICOROS_STD::vector<future<T>>&& futures, future<void>&& deadline) {
+  using ResultType = typename detail::settled_vector_result<T>::value_type;
+  auto chains = detail::unwrap_chains(MINICOROS_STD::move(futures));
+
+  return future<ResultType>([chains = MINICOROS_STD::move(chains), deadline_chain = MINICOROS_STD::move(deadline).chain()](promise<ResultType>&& p) mutable {
+    if (chains.empty()) {
+      deadline_chain.reset();
+      p(concrete_result<ResultType>{});
+      return;
+    }
+
+    auto result_builder = detail::make_fan_out_state<detail::settled_vector_result<T>>(chains.size() * detail::fan_out_bytes_per_chain<T, typename ResultType::value_type>(), MINICOROS_STD::move(p));
+    if (!result_builder) {
+      deadline_chain.reset();
+      return;
+    }
+
+    result_builder->resize(chains.size());
+
+    for (size_t i = 0; i < chains.size(); ++i) {
+      MINICOROS_STD::move(chains[i]).evaluate_into([i, result_builder] (concrete_result<T>&& result) {
+        result_builder->assign(i, MINICOROS_STD::move(result));
+      });
+    }
+
+    MINICOROS_STD::move(deadline_chain).evaluate_into([result_builder] (concrete_result<void>&&) {
+      result_builder->expire();
+    });
+  });
+}
+
 /// Returns the first result from any of the futures. If the first result is a failure,
 /// `when_any` will return that failure.
 template<typename T>
@@ -82,7 +151,9 @@ auto when_any(MINICOROS_STD::vector<future<T>>&& futures) {
       return;
     }
 
-    auto result_builder = MINICOROS_STD::make_shared<detail::any_result<T>>(MINICOROS_STD::move(p));
+    auto result_builder = detail::make_fan_out_state<detail::any_result<T>>(chains.size() * detail::fan_out_bytes_per_chain<T, void>(), MINICOROS_STD::move(p));
+    if (!result_builder)
+      return;
 
     for (size_t i = 0; i < chains.size(); ++i) {
       MINICOROS_STD::move(chains[static_cast<int>(i)]).evaluate_into([result_builder] (concrete_result<T>&& result) {
@@ -92,6 +163,49 @@ auto when_any(MINICOROS_STD::vector<future<T>>&& futures) {
   });
 }
 
+/// Returns the first result from any of the futures, which may have different types. The result is a variant with
+/// one alternative per future (in argument order, with `void` mapped to `monostate`); `index()` tells which future
+/// won. If the first result is a failure, `when_any` will return that failure.
+///
+/// ```cpp
+/// mc::when_any(cache.get(key), compute_fallback(key))
+///   .then([] (std::variant<cached_blob, document> winner) {
+///     ...
+///   });
+/// ```
+template<typename A, typename B, typename... Cs>
+auto when_any(future<A>&& a, future<B>&& b, future<Cs>&&... cs) {
+  using ResultType = MINICOROS_STD::variant<detail::variant_alternative_t<A>, detail::variant_alternative_t<B>, detail::variant_alternative_t<Cs>...>;
+  auto chains = MINICOROS_STD::make_tuple(MINICOROS_STD::move(a).chain(), MINICOROS_STD::move(b).chain(), MINICOROS_STD::move(cs).chain()...);
+
+  return future<ResultType>([chains = MINICOROS_STD::move(chains)](promise<ResultType>&& p) mutable {
+    const size_t fan_out_bytes = detail::fan_out_bytes_per_chain<A, void>() + detail::fan_out_bytes_per_chain<B, void>() + (detail::fan_out_bytes_per_chain<Cs, void>() + ... + 0);
+    auto result_builder = detail::make_fan_out_state<detail::any_variant_result<ResultType>>(fan_out_bytes, MINICOROS_STD::move(p));
+    if (!result_builder)
+      return;
+
+    detail::evaluate_into_any(MINICOROS_STD::move(chains), result_builder, MINICOROS_STD::index_sequence_for<A, B, Cs...>{});
+  });
+}
+
+/// Returns a future that resolves through the executor, giving other work on the executor a chance to run before the
+/// rest of the chain. See `mc::stage_budget` for yielding automatically.
+///
+/// ```cpp
+/// .then([&loop] (batch&& b) -> mc::result<void> {
+///   process_first_half(b);
+///   return mc::yield(loop).then([b = std::move(b)] { process_second_half(b); });
+/// })
+/// ```
+template<typename ExecutorType>
+future<void> yield(ExecutorType&& executor) {
+  return future<void>([executor = MINICOROS_STD::forward<ExecutorType>(executor)] (promise<void>&& p) mutable {
+    executor([p = MINICOROS_STD::move(p)] () mutable {
+      p({});
+    });
+  });
+}
+
 /// Evaluates the given futures in sequential order and returns all the results.
 template<typename T>
 auto when_seq(MINICOROS_STD::vector<future<T>>&& futures) {
@@ -104,7 +218,33 @@ auto when_seq(MINICOROS_STD::vector<future<T>>&& futures) {
       return;
     }
 
-    MINICOROS_STD::make_shared<detail::seq_submitter<T>>(MINICOROS_STD::move(p), MINICOROS_STD::move(chains))->evaluate();
+    const size_t fan_out_bytes = chains.size() * detail::fan_out_bytes_per_chain<T, T>();
+
+    if (auto submitter = detail::make_fan_out_state<detail::seq_submitter<T>>(fan_out_bytes, MINICOROS_STD::move(p), MINICOROS_STD::move(chains)))
+      submitter->evaluate();
+  });
+}
+
+/// Starts evaluating the future immediately rather than when something is attached to it ("hot start"). The
+/// result is buffered in the shared state until the returned future is evaluated, so work can be kicked off early
+/// and joined later:
+///
+/// ```cpp
+/// auto user = mc::spawn(fetch_user(id));
+/// auto config = mc::spawn(fetch_config());
+/// // ...
+/// return std::move(user) && std::move(config);
+/// ```
+template<typename T>
+future<T> spawn(future<T>&& fut) {
+  auto state = detail::make_shared_state<detail::spawned_result<T>>();
+
+  MINICOROS_STD::move(fut).chain().evaluate_into([state] (concrete_result<T>&& result) {
+    state->assign(MINICOROS_STD::move(result));
+  });
+
+  return future<T>([state = MINICOROS_STD::move(state)](promise<T>&& p) {
+    state->attach(MINICOROS_STD::move(p));
   });
 }
 
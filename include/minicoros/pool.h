@@ -0,0 +1,438 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_POOL_H_
+#define MINICOROS_POOL_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+#ifdef MINICOROS_USE_EASTL
+  #include <eastl/atomic.h>
+  #include <eastl/type_traits.h>
+  #include <eastl/utility.h>
+  #include <stddef.h>
+  #include <new>
+  #include <mutex>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD eastl
+  #endif
+#else
+  #include <atomic>
+  #include <type_traits>
+  #include <utility>
+  #include <cstddef>
+  #include <new>
+  #include <mutex>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD std
+  #endif
+#endif
+
+/// Largest block served by the pool; larger allocations go straight to `operator new`. Must be a multiple of 16.
+#ifndef MINICOROS_POOL_MAX_BLOCK_SIZE
+  #define MINICOROS_POOL_MAX_BLOCK_SIZE 256
+#endif
+
+/// Number of free blocks per size class that each thread keeps before it hands half of them to the global pool
+#ifndef MINICOROS_POOL_THREAD_CACHE_SIZE
+  #define MINICOROS_POOL_THREAD_CACHE_SIZE 128
+#endif
+
+namespace mc {
+
+/// Process-wide pooling allocator for the small, short-lived objects that chains allocate at high rates: chain links
+/// (through `mc::pooled_function`) and the shared state of combinators (through `mc::pool_allocator`). Blocks are
+/// rounded up to a multiple of 16 bytes. Each thread caches free blocks per size class, so allocating and freeing is
+/// a push or pop on a thread-local list. Threads exchange blocks with a global pool in batches: when their cache of a
+/// size class is full (blocks freed on another thread than they were allocated on end up there), and when it's empty.
+/// Blocks that are allocated or freed after the thread's cache has been destroyed, by the destructors of other
+/// thread-locals or of statics, go straight to the global pool.
+///
+/// Pooled memory is reused but never returned to the system.
+class pool {
+public:
+  static constexpr size_t granularity = 16;
+  static constexpr size_t num_size_classes = MINICOROS_POOL_MAX_BLOCK_SIZE / granularity;
+  static constexpr size_t batch_size = MINICOROS_POOL_THREAD_CACHE_SIZE / 2;
+
+  static_assert(MINICOROS_POOL_MAX_BLOCK_SIZE % granularity == 0, "MINICOROS_POOL_MAX_BLOCK_SIZE must be a multiple of 16");
+  static_assert(batch_size > 0, "MINICOROS_POOL_THREAD_CACHE_SIZE must be at least 2");
+
+  struct statistics {
+    size_t allocations;        // Pooled allocations made by this thread
+    size_t deallocations;      // Pooled deallocations made by this thread
+    size_t cache_hits;         // Allocations of this thread served from its cache
+    size_t global_refills;     // Batches that threads took from the global pool
+    size_t global_returns;     // Batches that threads handed to the global pool
+    size_t system_allocations; // Blocks allocated with `operator new`, ie, the size of the pool
+    size_t oversized;          // Allocations too large for the pool
+  };
+
+  static void* allocate(size_t size) {
+    if (size == 0 || size > MINICOROS_POOL_MAX_BLOCK_SIZE) {
+      counters().oversized.fetch_add(1, MINICOROS_STD::memory_order_relaxed);
+      return ::operator new(size);
+    }
+
+    const size_t size_class = size_class_of(size);
+    thread_cache* cache_ptr = local_cache();
+
+    if (!cache_ptr)
+      return allocate_uncached(size_class);
+
+    thread_cache& cache = *cache_ptr;
+    ++cache.num_allocations;
+
+    if (!cache.heads[size_class])
+      refill(cache, size_class);
+    else
+      ++cache.num_cache_hits;
+
+    free_block* block = cache.heads[size_class];
+    cache.heads[size_class] = block->next;
+    --cache.counts[size_class];
+    return block;
+  }
+
+  static void deallocate(void* ptr, size_t size) {
+    if (size == 0 || size > MINICOROS_POOL_MAX_BLOCK_SIZE) {
+      ::operator delete(ptr);
+      return;
+    }
+
+    const size_t size_class = size_class_of(size);
+    free_block* block = static_cast<free_block*>(ptr);
+    thread_cache* cache_ptr = local_cache();
+
+    if (!cache_ptr) {
+      deallocate_uncached(block, size_class);
+      return;
+    }
+
+    thread_cache& cache = *cache_ptr;
+    ++cache.num_deallocations;
+
+    block->next = cache.heads[size_class];
+    cache.heads[size_class] = block;
+
+    if (++cache.counts[size_class] >= MINICOROS_POOL_THREAD_CACHE_SIZE)
+      return_batch(cache, size_class, batch_size);
+  }
+
+  /// Hands all blocks cached by this thread to the global pool, eg, before a thread goes idle for a long time.
+  static void trim() {
+    thread_cache* cache = local_cache();
+
+    if (!cache)
+      return;
+
+    for (size_t size_class = 0; size_class < num_size_classes; ++size_class) {
+      if (cache->counts[size_class])
+        return_batch(*cache, size_class, cache->counts[size_class]);
+    }
+  }
+
+  static statistics stats() {
+    const thread_cache* cache = local_cache();
+    const global_counters& global = counters();
+
+    return statistics{
+      cache ? cache->num_allocations : 0,
+      cache ? cache->num_deallocations : 0,
+      cache ? cache->num_cache_hits : 0,
+      global.refills.load(MINICOROS_STD::memory_order_relaxed),
+      global.returns.load(MINICOROS_STD::memory_order_relaxed),
+      global.system_allocations.load(MINICOROS_STD::memory_order_relaxed),
+      global.oversized.load(MINICOROS_STD::memory_order_relaxed)};
+  }
+
+  static constexpr size_t size_class_of(size_t size) {
+    return (size + granularity - 1) / granularity - 1;
+  }
+
+private:
+  struct free_block {
+    free_block* next;
+  };
+
+  struct thread_cache {
+    free_block* heads[num_size_classes] = {};
+    size_t counts[num_size_classes] = {};
+    size_t num_allocations = 0;
+    size_t num_deallocations = 0;
+    size_t num_cache_hits = 0;
+
+    ~thread_cache() {
+      for (size_t size_class = 0; size_class < num_size_classes; ++size_class) {
+        if (counts[size_class])
+          return_batch(*this, size_class, counts[size_class]);
+      }
+
+      cache_destroyed() = true;
+    }
+  };
+
+  struct global_pool {
+    std::mutex mutex;
+    free_block* heads[num_size_classes] = {};
+  };
+
+  struct global_counters {
+    MINICOROS_STD::atomic<size_t> refills{0};
+    MINICOROS_STD::atomic<size_t> returns{0};
+    MINICOROS_STD::atomic<size_t> system_allocations{0};
+    MINICOROS_STD::atomic<size_t> oversized{0};
+  };
+
+  /// Null once the thread's cache has been destroyed
+  static thread_cache* local_cache() {
+    if (cache_destroyed())
+      return nullptr;
+
+    thread_local thread_cache cache;
+    return &cache;
+  }
+
+  // Trivially destructible, so it can still be read after the thread's other thread-locals are gone
+  static bool& cache_destroyed() {
+    thread_local bool destroyed = false;
+    return destroyed;
+  }
+
+  // Never destroyed, since thread caches return their blocks when their threads exit
+  static global_pool& global() {
+    static global_pool* pool = new global_pool;
+    return *pool;
+  }
+
+  static global_counters& counters() {
+    static global_counters* counters = new global_counters;
+    return *counters;
+  }
+
+  /// Takes a batch from the global pool, or allocates a new block if the global pool is empty.
+  static void refill(thread_cache& cache, size_t size_class) {
+    {
+      global_pool& pool = global();
+      std::lock_guard<std::mutex> lock{pool.mutex};
+      free_block* head = pool.heads[size_class];
+
+      if (head) {
+        free_block* last = head;
+        size_t count = 1;
+
+        for (; count < batch_size && last->next; ++count)
+          last = last->next;
+
+        pool.heads[size_class] = last->next;
+        last->next = nullptr;
+        cache.heads[size_class] = head;
+        cache.counts[size_class] = count;
+      }
+    }
+
+    if (cache.heads[size_class]) {
+      counters().refills.fetch_add(1, MINICOROS_STD::memory_order_relaxed);
+      return;
+    }
+
+    counters().system_allocations.fetch_add(1, MINICOROS_STD::memory_order_relaxed);
+    free_block* block = static_cast<free_block*>(::operator new((size_class + 1) * granularity));
+    block->next = nullptr;
+    cache.heads[size_class] = block;
+    cache.counts[size_class] = 1;
+  }
+
+  /// Takes a single block from the global pool, or allocates a new one, for a thread without a cache.
+  static void* allocate_uncached(size_t size_class) {
+    {
+      global_pool& pool = global();
+      std::lock_guard<std::mutex> lock{pool.mutex};
+
+      if (free_block* block = pool.heads[size_class]) {
+        pool.heads[size_class] = block->next;
+        return block;
+      }
+    }
+
+    counters().system_allocations.fetch_add(1, MINICOROS_STD::memory_order_relaxed);
+    return ::operator new((size_class + 1) * granularity);
+  }
+
+  static void deallocate_uncached(free_block* block, size_t size_class) {
+    global_pool& pool = global();
+    std::lock_guard<std::mutex> lock{pool.mutex};
+    block->next = pool.heads[size_class];
+    pool.heads[size_class] = block;
+  }
+
+  static void return_batch(thread_cache& cache, size_t size_class, size_t count) {
+    free_block* head = cache.heads[size_class];
+    free_block* last = head;
+
+    for (size_t i = 1; i < count; ++i)
+      last = last->next;
+
+    cache.heads[size_class] = last->next;
+    cache.counts[size_class] -= count;
+
+    counters().returns.fetch_add(1, MINICOROS_STD::memory_order_relaxed);
+    global_pool& pool = global();
+    std::lock_guard<std::mutex> lock{pool.mutex};
+    last->next = pool.heads[size_class];
+    pool.heads[size_class] = head;
+  }
+};
+
+/// Standard allocator on top of `mc::pool`. Define `MINICOROS_SHARED_STATE_ALLOCATOR` as `mc::pool_allocator` to
+/// allocate the shared state of combinators from the pool.
+template<typename T>
+class pool_allocator {
+public:
+  using value_type = T;
+
+  pool_allocator() = default;
+
+  template<typename U>
+  pool_allocator(const pool_allocator<U>&) {}
+
+  T* allocate(size_t n) {
+    static_assert(alignof(T) <= pool::granularity, "pool_allocator doesn't support over-aligned types");
+    return static_cast<T*>(pool::allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    pool::deallocate(ptr, n * sizeof(T));
+  }
+
+  template<typename U>
+  bool operator ==(const pool_allocator<U>&) const {
+    return true;
+  }
+
+  template<typename U>
+  bool operator !=(const pool_allocator<U>&) const {
+    return false;
+  }
+};
+
+template<typename Signature>
+class pooled_function;
+
+/// Drop-in replacement for `std::function` that allocates its callable from `mc::pool`. Chain links are the bulk of
+/// what chains allocate, so pooling the function type pools them as well. Include this header first and define
+/// `MINICOROS_FUNCTION_TYPE` (in every translation unit) to use it throughout the library:
+///
+/// ```cpp
+/// #include <minicoros/pool.h>
+/// #define MINICOROS_FUNCTION_TYPE mc::pooled_function
+/// #define MINICOROS_SHARED_STATE_ALLOCATOR mc::pool_allocator
+/// #include <minicoros/minicoros.h>
+/// ```
+///
+/// Unlike `std::function`, callables are always allocated, even small ones; a pooled allocation is cheap enough.
+/// The work that `future::enqueue` hands to an executor is stored by the executor, so the executor decides whether it
+/// is pooled: `mc::microtask_queue` stores it in a `MINICOROS_FUNCTION_TYPE`, other executors can use a
+/// `pooled_function<void()>`.
+template<typename R, typename... Args>
+class pooled_function<R(Args...)> {
+public:
+  pooled_function() = default;
+  pooled_function(decltype(nullptr)) {}
+
+  template<typename F, typename = MINICOROS_STD::enable_if_t<!MINICOROS_STD::is_same_v<MINICOROS_STD::decay_t<F>, pooled_function>>>
+  pooled_function(F&& callable) {
+    using CallableType = MINICOROS_STD::decay_t<F>;
+    static_assert(alignof(CallableType) <= pool::granularity, "pooled_function doesn't support over-aligned callables");
+
+    callable_ = new (pool::allocate(sizeof(CallableType))) CallableType(MINICOROS_STD::forward<F>(callable));
+    operations_ = &operations_for<CallableType>;
+  }
+
+  pooled_function(const pooled_function& other) : operations_(other.operations_) {
+    if (operations_)
+      callable_ = operations_->clone(other.callable_);
+  }
+
+  pooled_function(pooled_function&& other) : callable_(other.callable_), operations_(other.operations_) {
+    other.callable_ = nullptr;
+    other.operations_ = nullptr;
+  }
+
+  ~pooled_function() {
+    reset();
+  }
+
+  pooled_function& operator =(const pooled_function& other) {
+    pooled_function{other}.swap(*this);
+    return *this;
+  }
+
+  pooled_function& operator =(pooled_function&& other) {
+    pooled_function{MINICOROS_STD::move(other)}.swap(*this);
+    return *this;
+  }
+
+  pooled_function& operator =(decltype(nullptr)) {
+    reset();
+    return *this;
+  }
+
+  template<typename F, typename = MINICOROS_STD::enable_if_t<!MINICOROS_STD::is_same_v<MINICOROS_STD::decay_t<F>, pooled_function>>>
+  pooled_function& operator =(F&& callable) {
+    pooled_function{MINICOROS_STD::forward<F>(callable)}.swap(*this);
+    return *this;
+  }
+
+  R operator()(Args... args) const {
+    return operations_->invoke(callable_, MINICOROS_STD::forward<Args>(args)...);
+  }
+
+  explicit operator bool() const {
+    return operations_ != nullptr;
+  }
+
+  void swap(pooled_function& other) {
+    MINICOROS_STD::swap(callable_, other.callable_);
+    MINICOROS_STD::swap(operations_, other.operations_);
+  }
+
+private:
+  struct operations {
+    R (*invoke)(void* callable, Args&&... args);
+    void* (*clone)(const void* callable);
+    void (*destroy)(void* callable);
+  };
+
+  template<typename CallableType>
+  static constexpr operations operations_for = {
+    [] (void* callable, Args&&... args) -> R {
+      return (*static_cast<CallableType*>(callable))(MINICOROS_STD::forward<Args>(args)...);
+    },
+    [] (const void* callable) -> void* {
+      return new (pool::allocate(sizeof(CallableType))) CallableType(*static_cast<const CallableType*>(callable));
+    },
+    [] (void* callable) {
+      static_cast<CallableType*>(callable)->~CallableType();
+      pool::deallocate(callable, sizeof(CallableType));
+    },
+  };
+
+  void reset() {
+    if (operations_)
+      operations_->destroy(callable_);
+
+    callable_ = nullptr;
+    operations_ = nullptr;
+  }
+
+  void* callable_ = nullptr;
+  const operations* operations_ = nullptr;
+};
+
+} // mc
+
+#endif // MINICOROS_POOL_H_
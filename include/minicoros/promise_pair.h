@@ -0,0 +1,310 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_PROMISE_PAIR_H_
+#define MINICOROS_PROMISE_PAIR_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+#include <minicoros/future.h>
+
+#ifdef MINICOROS_USE_EASTL
+  #include <eastl/atomic.h>
+  #include <eastl/optional.h>
+  #include <eastl/utility.h>
+  #include <stdint.h>
+  #include <cassert>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD eastl
+  #endif
+#else
+  #include <atomic>
+  #include <optional>
+  #include <utility>
+  #include <cstdint>
+  #include <cassert>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD std
+  #endif
+#endif
+
+namespace mc {
+
+namespace detail {
+
+/// Rendezvous between a future and the promise that resolves it from the outside. Whichever side arrives second (the
+/// chain attaching its continuation or the result coming in) hands the result over; the two may be on different
+/// threads. Heap-allocated states are reference counted and destroyed through `destroy`; caller-provided ones
+/// (`promise_slot`) have no `destroy` and aren't counted.
+template<typename T>
+class promise_state {
+public:
+  using destroy_function = void (*)(promise_state*);
+
+  explicit promise_state(destroy_function destroy) : destroy_(destroy) {}
+
+  promise_state(const promise_state&) = delete;
+  promise_state& operator =(const promise_state&) = delete;
+
+  void attach(promise<T>&& p) {
+    continuation_ = MINICOROS_STD::move(p);
+
+    if (flags_.fetch_or(attached_flag, MINICOROS_STD::memory_order_acq_rel) & resolved_flag)
+      deliver();
+  }
+
+  void resolve(concrete_result<T>&& result) {
+    assert(!result_ && "promise resolved more than once");
+    result_.emplace(MINICOROS_STD::move(result));
+
+    if (flags_.fetch_or(resolved_flag, MINICOROS_STD::memory_order_acq_rel) & attached_flag)
+      deliver();
+  }
+
+  bool resolved() const {
+    return flags_.load(MINICOROS_STD::memory_order_acquire) & resolved_flag;
+  }
+
+  bool attached() const {
+    return flags_.load(MINICOROS_STD::memory_order_acquire) & attached_flag;
+  }
+
+  void add_ref() {
+    if (destroy_)
+      num_refs_.fetch_add(1, MINICOROS_STD::memory_order_relaxed);
+  }
+
+  void release() {
+    if (destroy_ && num_refs_.fetch_sub(1, MINICOROS_STD::memory_order_acq_rel) == 1)
+      destroy_(this);
+  }
+
+  /// Makes a caller-provided state reusable, see `promise_slot::reset`.
+  void reset() {
+    result_.reset();
+    continuation_ = {};
+    flags_.store(0, MINICOROS_STD::memory_order_relaxed);
+  }
+
+private:
+  static constexpr uint8_t attached_flag = 1;
+  static constexpr uint8_t resolved_flag = 2;
+
+  void deliver() {
+    promise<T> continuation = MINICOROS_STD::move(continuation_);
+    continuation_ = {};
+    continuation(MINICOROS_STD::move(*result_));
+  }
+
+  MINICOROS_STD::optional<concrete_result<T>> result_;
+  promise<T> continuation_;
+  MINICOROS_STD::atomic<uint8_t> flags_{0};
+  MINICOROS_STD::atomic<uint32_t> num_refs_{2}; // The promise handle and the future
+  destroy_function destroy_;
+};
+
+/// Reference held by the future of a promise/future pair.
+template<typename T>
+class promise_state_ref {
+public:
+  explicit promise_state_ref(promise_state<T>* state) : state_(state) {}
+
+  promise_state_ref(const promise_state_ref& other) : state_(other.state_) {
+    state_->add_ref();
+  }
+
+  promise_state_ref(promise_state_ref&& other) : state_(MINICOROS_STD::exchange(other.state_, nullptr)) {}
+
+  promise_state_ref& operator =(const promise_state_ref&) = delete;
+  promise_state_ref& operator =(promise_state_ref&&) = delete;
+
+  ~promise_state_ref() {
+    if (state_)
+      state_->release();
+  }
+
+  promise_state<T>* operator ->() const {
+    return state_;
+  }
+
+private:
+  promise_state<T>* state_;
+};
+
+template<typename T, auto Convert>
+struct c_trampoline_impl;
+
+template<typename T, typename ReturnType, typename... Args, ReturnType (*Convert)(Args...)>
+struct c_trampoline_impl<T, Convert> {
+  static void invoke(void* user_data, Args... args) {
+    promise_state<T>* state = static_cast<promise_state<T>*>(user_data);
+    state->resolve(concrete_result<T>{Convert(MINICOROS_STD::forward<Args>(args)...)});
+    state->release();
+  }
+};
+
+} // detail
+
+/// The resolving end of a promise/future pair, see `make_promise_future_pair`. Move-only; resolve it once.
+template<typename T>
+class promise_handle {
+public:
+  promise_handle() = default;
+
+  promise_handle(promise_handle&& other) : state_(MINICOROS_STD::exchange(other.state_, nullptr)) {}
+
+  promise_handle& operator =(promise_handle&& other) {
+    promise_handle{MINICOROS_STD::move(other)}.swap(*this);
+    return *this;
+  }
+
+  promise_handle(const promise_handle&) = delete;
+  promise_handle& operator =(const promise_handle&) = delete;
+
+  ~promise_handle() {
+    if (state_)
+      state_->release();
+  }
+
+  void operator()(concrete_result<T>&& result) {
+    assert(state_ && "empty promise handle");
+    state_->resolve(MINICOROS_STD::move(result));
+  }
+
+  explicit operator bool() const {
+    return state_ != nullptr;
+  }
+
+  /// Gives up ownership and returns a pointer that can travel through a C API's `void* user_data`. Resolve it with
+  /// `mc::c_trampoline` or turn it back into a handle with `adopt`.
+  void* release() {
+    return MINICOROS_STD::exchange(state_, nullptr);
+  }
+
+  static promise_handle adopt(void* user_data) {
+    promise_handle handle;
+    handle.state_ = static_cast<detail::promise_state<T>*>(user_data);
+    return handle;
+  }
+
+  void swap(promise_handle& other) {
+    MINICOROS_STD::swap(state_, other.state_);
+  }
+
+private:
+  template<typename U>
+  friend MINICOROS_STD::pair<promise_handle<U>, future<U>> make_promise_future_pair();
+
+  detail::promise_state<T>* state_ = nullptr;
+};
+
+/// Creates a future together with the handle that resolves it, for bridging callback-based APIs without stashing a
+/// promise from inside a `future<T>([&] (promise<T> p) { ... })` activator. The promise and the future share a single
+/// reference counted allocation. (Standard libraries that only store trivially copyable callables inline in
+/// `std::function`, such as libstdc++, add one for the future's reference.)
+///
+/// ```cpp
+/// auto [p, fut] = mc::make_promise_future_pair<size_t>();
+/// socket.async_write(buffer, [p = std::move(p)] (size_t written) mutable { p({std::move(written)}); });
+/// return std::move(fut);
+/// ```
+template<typename T>
+MINICOROS_STD::pair<promise_handle<T>, future<T>> make_promise_future_pair() {
+  auto* state = new detail::promise_state<T>([] (detail::promise_state<T>* self) { delete self; });
+
+  promise_handle<T> handle;
+  handle.state_ = state;
+
+  future<T> fut{[ref = detail::promise_state_ref<T>{state}] (promise<T>&& p) {
+    ref->attach(MINICOROS_STD::move(p));
+  }};
+
+  return {MINICOROS_STD::move(handle), MINICOROS_STD::move(fut)};
+}
+
+/// Caller-provided storage for a promise/future pair that doesn't allocate at all, for embedding in objects that
+/// already exist per operation (an I/O request, a connection). The slot must outlive the evaluation of its future and
+/// must not be moved. `reset` makes it reusable once its future has resolved.
+///
+/// ```cpp
+/// struct read_request {
+///   uv_fs_t req;
+///   mc::promise_slot<ssize_t> done;
+/// };
+///
+/// r->req.data = r->done.c_user_data();
+/// uv_fs_read(loop, &r->req, fd, &buf, 1, -1, [] (uv_fs_t* req) {
+///   mc::resolve_c_user_data<ssize_t>(req->data, {ssize_t{req->result}});
+/// });
+/// return r->done.get_future();
+/// ```
+template<typename T>
+class promise_slot {
+public:
+  promise_slot() : state_(nullptr) {}
+
+  promise_slot(const promise_slot&) = delete;
+  promise_slot& operator =(const promise_slot&) = delete;
+
+  ~promise_slot() {
+    assert((!state_.attached() || state_.resolved()) && "promise_slot destroyed while its future is waiting");
+  }
+
+  /// Returns the future that the slot resolves. Call once per use of the slot.
+  future<T> get_future() {
+    return future<T>{[state = &state_] (promise<T>&& p) {
+      state->attach(MINICOROS_STD::move(p));
+    }};
+  }
+
+  void operator()(concrete_result<T>&& result) {
+    state_.resolve(MINICOROS_STD::move(result));
+  }
+
+  /// Pointer for a C API's `void* user_data`, see `mc::resolve_c_user_data` and `mc::c_trampoline`.
+  void* c_user_data() {
+    return &state_;
+  }
+
+  void reset() {
+    assert((!state_.attached() || state_.resolved()) && "promise_slot reset while its future is waiting");
+    state_.reset();
+  }
+
+private:
+  detail::promise_state<T> state_;
+};
+
+/// Resolves the promise behind a `void* user_data` that was obtained from `promise_handle<T>::release` or
+/// `promise_slot<T>::c_user_data`. Consumes the user data.
+template<typename T>
+void resolve_c_user_data(void* user_data, concrete_result<T>&& result) {
+  detail::promise_state<T>* state = static_cast<detail::promise_state<T>*>(user_data);
+  state->resolve(MINICOROS_STD::move(result));
+  state->release();
+}
+
+/// Callback for C APIs that take a function pointer and a `void* user_data` to pass as its first argument. The user
+/// data is as for `resolve_c_user_data`; the trampoline converts the callback's
+/// remaining arguments to a result with `Convert` and resolves the promise with it:
+///
+/// ```cpp
+/// mc::concrete_result<size_t> from_status(int status, size_t bytes) {
+///   if (status != 0)
+///     return mc::failure{std::move(status)};
+///
+///   return {std::move(bytes)};
+/// }
+///
+/// auto [p, fut] = mc::make_promise_future_pair<size_t>();
+/// lib_async_read(handle, buf, len, mc::c_trampoline<size_t, &from_status>, p.release());
+/// ```
+template<typename T, auto Convert>
+constexpr auto c_trampoline = &detail::c_trampoline_impl<T, Convert>::invoke;
+
+} // mc
+
+#endif // MINICOROS_PROMISE_PAIR_H_
@@ -0,0 +1,234 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_RATE_LIMITER_H_
+#define MINICOROS_RATE_LIMITER_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+#include <minicoros/future.h>
+#include <minicoros/detail/operation_helpers.h>
+
+#ifdef MINICOROS_USE_EASTL
+  #include <eastl/chrono.h>
+  #include <eastl/shared_ptr.h>
+  #include <eastl/utility.h>
+  #include <eastl/vector.h>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD eastl
+  #endif
+#else
+  #include <chrono>
+  #include <memory>
+  #include <utility>
+  #include <vector>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD std
+  #endif
+#endif
+
+namespace mc {
+
+namespace detail {
+
+/// FIFO queue on a ring buffer that only allocates when it has to grow, so a queue that has reached its working size
+/// doesn't allocate per element.
+template<typename T>
+class ring_queue {
+public:
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  T& front() {
+    return slots_[head_];
+  }
+
+  void push_back(T&& value) {
+    if (size_ == slots_.size())
+      grow();
+
+    slots_[(head_ + size_) % slots_.size()] = MINICOROS_STD::move(value);
+    ++size_;
+  }
+
+  void pop_front() {
+    slots_[head_] = T{};
+    head_ = (head_ + 1) % slots_.size();
+    --size_;
+  }
+
+private:
+  void grow() {
+    MINICOROS_STD::vector<T> slots;
+    slots.resize(slots_.empty() ? 8 : slots_.size() * 2);
+
+    for (size_t i = 0; i < size_; ++i)
+      slots[i] = MINICOROS_STD::move(slots_[(head_ + i) % slots_.size()]);
+
+    slots_ = MINICOROS_STD::move(slots);
+    head_ = 0;
+  }
+
+  MINICOROS_STD::vector<T> slots_;
+  size_t head_ = 0;
+  size_t size_ = 0;
+};
+
+} // detail
+
+/// Token bucket that hands out permits as futures instead of blocking or polling. The bucket holds up to `burst`
+/// tokens and refills at `tokens_per_second`. `acquire(n)` resolves once `n` tokens could be taken; waiters are served
+/// strictly in FIFO order, so a large request isn't starved by a stream of small ones.
+///
+/// The clock and the timer are pluggable, which makes the limiter usable with any event loop (and testable with a
+/// fake clock). The timer is called with a point in time and a callback to run at (or after) that time; the limiter
+/// only ever has one timer outstanding.
+///
+/// Acquisitions that could never be served fail with `rejected_error` instead of blocking the queue for good: those
+/// asking for more than `burst` tokens, and all of them if the rate or the burst size isn't positive. So do those
+/// asking for a negative number of tokens, which would otherwise return tokens beyond the burst.
+///
+/// ```cpp
+/// mc::rate_limiter limiter{100, 10, error::rate_limited, [&loop] (auto when, auto&& callback) {
+///   loop.run_at(when, std::move(callback));
+/// }};
+///
+/// limiter.acquire()
+///   .then([] () -> mc::result<response> { return partner_api.call(request); });
+/// ```
+///
+/// Waiters are kept in a ring buffer, so once the queue has grown to its working size, waiting doesn't allocate.
+/// Not thread-safe: acquire from, and run the timer callbacks on, a single thread.
+class rate_limiter {
+public:
+  using clock = MINICOROS_STD::chrono::steady_clock;
+  using callback_type = MINICOROS_FUNCTION_TYPE<void()>;
+  using timer_type = MINICOROS_FUNCTION_TYPE<void(clock::time_point, callback_type&&)>;
+  using now_type = MINICOROS_FUNCTION_TYPE<clock::time_point()>;
+
+  rate_limiter(double tokens_per_second, double burst, MINICOROS_ERROR_TYPE&& rejected_error, timer_type&& timer, now_type&& now = [] { return clock::now(); })
+    : state_(detail::make_shared_state<state>(tokens_per_second, burst, MINICOROS_STD::move(rejected_error), MINICOROS_STD::move(timer), MINICOROS_STD::move(now))) {}
+
+  /// Returns a future that resolves once `n` tokens have been taken from the bucket. Tokens are taken when the future
+  /// is evaluated. Fails with the rejected error if `n` exceeds the burst size.
+  future<void> acquire(double n = 1) {
+    return future<void>([state = state_, n] (promise<void>&& p) {
+      state->acquire(n, MINICOROS_STD::move(p));
+    });
+  }
+
+  /// Tokens in the bucket right now
+  double available_tokens() const {
+    state_->refill();
+    return state_->tokens;
+  }
+
+  size_t num_waiters() const {
+    return state_->waiters.size();
+  }
+
+private:
+  struct waiter {
+    double num_tokens = 0;
+    promise<void> p;
+  };
+
+  /// Shared with the pending timer callback and the acquiring futures, so that the limiter can go away before them.
+  struct state : MINICOROS_STD::enable_shared_from_this<state> {
+    state(double tokens_per_second, double burst, MINICOROS_ERROR_TYPE&& rejected_error, timer_type&& timer, now_type&& now)
+      : tokens_per_second(tokens_per_second)
+      , burst(burst)
+      , tokens(valid() ? burst : 0)
+      , rejected_error(MINICOROS_STD::move(rejected_error))
+      , timer(MINICOROS_STD::move(timer))
+      , now(MINICOROS_STD::move(now))
+      , last_refill(this->now()) {}
+
+    /// Without a positive rate a waiter would never be served, and the timer would divide by zero. (Written so that
+    /// NaNs are rejected too.)
+    bool valid() const {
+      return tokens_per_second > 0 && burst > 0;
+    }
+
+    void acquire(double n, promise<void>&& p) {
+      // Tokens are capped at the burst size, so a larger request would block the queue forever. A negative one would
+      // add tokens beyond the burst.
+      if (!valid() || !(n >= 0 && n <= burst)) {
+        p(failure{MINICOROS_ERROR_TYPE{rejected_error}});
+        return;
+      }
+
+      refill();
+
+      if (waiters.empty() && tokens >= n) {
+        tokens -= n;
+        p({});
+        return;
+      }
+
+      waiters.push_back(waiter{n, MINICOROS_STD::move(p)});
+      arm_timer();
+    }
+
+    void refill() {
+      const clock::time_point current_time = now();
+      const double elapsed = MINICOROS_STD::chrono::duration<double>(current_time - last_refill).count();
+      tokens = MINICOROS_STD::min(burst, tokens + elapsed * tokens_per_second);
+      last_refill = current_time;
+    }
+
+    void serve_waiters() {
+      timer_armed = false;
+      refill();
+
+      while (!waiters.empty() && tokens >= waiters.front().num_tokens) {
+        tokens -= waiters.front().num_tokens;
+        promise<void> p = MINICOROS_STD::move(waiters.front().p);
+        waiters.pop_front();
+        p({});
+      }
+
+      if (!waiters.empty())
+        arm_timer();
+    }
+
+    /// Schedules a wake-up for when the first waiter's tokens will have accumulated.
+    void arm_timer() {
+      if (timer_armed)
+        return;
+
+      timer_armed = true;
+      const double missing_tokens = waiters.front().num_tokens - tokens;
+      const auto wait = MINICOROS_STD::chrono::duration_cast<clock::duration>(MINICOROS_STD::chrono::duration<double>(missing_tokens / tokens_per_second));
+
+      // Round up, so that the callback doesn't find the bucket a fraction of a token short
+      timer(last_refill + wait + clock::duration{1}, [self = this->shared_from_this()] {
+        self->serve_waiters();
+      });
+    }
+
+    double tokens_per_second;
+    double burst;
+    double tokens;
+    MINICOROS_ERROR_TYPE rejected_error;
+    timer_type timer;
+    now_type now;
+    clock::time_point last_refill;
+    detail::ring_queue<waiter> waiters;
+    bool timer_armed = false;
+  };
+
+  MINICOROS_STD::shared_ptr<state> state_;
+};
+
+} // mc
+
+#endif // MINICOROS_RATE_LIMITER_H_
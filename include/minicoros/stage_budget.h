@@ -0,0 +1,112 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_STAGE_BUDGET_H_
+#define MINICOROS_STAGE_BUDGET_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+#ifdef MINICOROS_USE_EASTL
+  #include <eastl/chrono.h>
+  #include <eastl/functional.h>
+  #include <eastl/utility.h>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD eastl
+  #endif
+
+  #ifndef MINICOROS_FUNCTION_TYPE
+    #define MINICOROS_FUNCTION_TYPE eastl::function
+  #endif
+#else
+  #include <chrono>
+  #include <functional>
+  #include <utility>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD std
+  #endif
+
+  #ifndef MINICOROS_FUNCTION_TYPE
+    #define MINICOROS_FUNCTION_TYPE std::function
+  #endif
+#endif
+
+namespace mc {
+
+/// Bounds the amount of synchronous work that chains may do before giving the thread back. While a budget is in
+/// scope, every chain stage that runs on the thread is counted; once the budget is exhausted (after `max_stages`
+/// stages or `max_duration`, whichever comes first), the remaining stages of the chains are handed to the executor
+/// instead of being run inline.
+///
+/// Typically set up by an event loop around each unit of work it runs:
+///
+/// ```cpp
+/// for (auto& work : queue.take_all()) {
+///   mc::stage_budget budget{[&queue] (auto&& rest) { queue.push(std::move(rest)); }, 256, 200us};
+///   work();
+/// }
+/// ```
+class stage_budget {
+public:
+  using clock = MINICOROS_STD::chrono::steady_clock;
+  using work_type = MINICOROS_FUNCTION_TYPE<void()>;
+  using executor_type = MINICOROS_FUNCTION_TYPE<void(work_type&&)>;
+
+  stage_budget(executor_type&& executor, size_t max_stages, clock::duration max_duration = clock::duration::max())
+    : executor_(MINICOROS_STD::move(executor))
+    , max_stages_(max_stages)
+    , max_duration_(max_duration)
+    , start_(max_duration == clock::duration::max() ? clock::time_point{} : clock::now())
+    , previous_(current_slot()) {
+    current_slot() = this;
+  }
+
+  ~stage_budget() {
+    current_slot() = previous_;
+  }
+
+  stage_budget(const stage_budget&) = delete;
+  stage_budget& operator =(const stage_budget&) = delete;
+
+  /// The innermost budget on this thread, or null
+  static stage_budget* current() {
+    return current_slot();
+  }
+
+  /// Accounts for one stage and returns whether it has to be rescheduled instead of run.
+  bool consume() {
+    if (exhausted_)
+      return true;
+
+    exhausted_ = ++num_stages_ > max_stages_ || (max_duration_ != clock::duration::max() && clock::now() - start_ >= max_duration_);
+    return exhausted_;
+  }
+
+  void reschedule(work_type&& work) {
+    executor_(MINICOROS_STD::move(work));
+  }
+
+  size_t num_stages() const {
+    return num_stages_;
+  }
+
+private:
+  static stage_budget*& current_slot() {
+    thread_local stage_budget* current = nullptr;
+    return current;
+  }
+
+  executor_type executor_;
+  size_t max_stages_;
+  clock::duration max_duration_;
+  clock::time_point start_;
+  size_t num_stages_ = 0;
+  bool exhausted_ = false;
+  stage_budget* previous_;
+};
+
+} // mc
+
+#endif // MINICOROS_STAGE_BUDGET_H_
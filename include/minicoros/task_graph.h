@@ -0,0 +1,356 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_TASK_GRAPH_H_
+#define MINICOROS_TASK_GRAPH_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+#include <minicoros/future.h>
+#include <minicoros/detail/operation_helpers.h>
+
+#ifdef MINICOROS_USE_EASTL
+  #include <eastl/heap.h>
+  #include <eastl/initializer_list.h>
+  #include <eastl/optional.h>
+  #include <eastl/shared_ptr.h>
+  #include <eastl/type_traits.h>
+  #include <eastl/utility.h>
+  #include <eastl/vector.h>
+  #include <stdint.h>
+  #include <cassert>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD eastl
+  #endif
+#else
+  #include <algorithm>
+  #include <initializer_list>
+  #include <optional>
+  #include <memory>
+  #include <type_traits>
+  #include <utility>
+  #include <vector>
+  #include <cstdint>
+  #include <cassert>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD std
+  #endif
+#endif
+
+namespace mc {
+
+template<typename T>
+class task_graph;
+
+namespace detail {
+
+template<typename T>
+class task_graph_state;
+
+} // detail
+
+/// Results of the dependencies of a `task_graph` node, in the order the dependencies were declared. Only valid while
+/// the node's task runs; copy what the returned future needs.
+template<typename T>
+class task_inputs {
+public:
+  size_t size() const {
+    return num_inputs_;
+  }
+
+  const T& operator[](size_t index) const {
+    assert(index < num_inputs_ && "task input out of range");
+    return *results_[dependencies_[index]];
+  }
+
+private:
+  friend class detail::task_graph_state<T>;
+
+  task_inputs(const size_t* dependencies, size_t num_inputs, const MINICOROS_STD::optional<T>* results)
+    : dependencies_(dependencies), num_inputs_(num_inputs), results_(results) {}
+
+  const size_t* dependencies_;
+  size_t num_inputs_;
+  const MINICOROS_STD::optional<T>* results_;
+};
+
+namespace detail {
+
+template<typename T>
+struct task_graph_node {
+  MINICOROS_FUNCTION_TYPE<future<T>(task_inputs<T>)> task;
+  uint64_t estimated_cost;
+  size_t first_dependency;    // Into `dependencies`
+  size_t num_dependencies;
+  size_t first_dependent;     // Into `dependents`
+  size_t num_dependents;
+  size_t num_pending_dependencies;
+  size_t num_pending_dependents; // Dependents that haven't consumed the result yet
+  uint64_t critical_path;     // Estimated cost of the longest path from this node to a sink
+};
+
+/// The state of a running graph: the nodes, both directions of the edges, and the results. Each is an array that's
+/// sized once when the graph starts, so running the graph doesn't allocate beyond what the tasks themselves need;
+/// results are kept in place until their last dependent has consumed them.
+template<typename T>
+class task_graph_state : public MINICOROS_STD::enable_shared_from_this<task_graph_state<T>> {
+public:
+  task_graph_state(MINICOROS_STD::vector<task_graph_node<T>>&& nodes, MINICOROS_STD::vector<size_t>&& dependencies,
+                   size_t output, size_t max_concurrency, promise<T>&& p)
+    : nodes_(MINICOROS_STD::move(nodes))
+    , dependencies_(MINICOROS_STD::move(dependencies))
+    , results_(nodes_.size())
+    , output_(output)
+    , max_concurrency_(max_concurrency)
+    , promise_(MINICOROS_STD::move(p)) {
+    link_dependents();
+    compute_critical_paths();
+    ready_.reserve(nodes_.size());
+  }
+
+  void start() {
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+      if (nodes_[i].num_pending_dependencies == 0)
+        push_ready(i);
+    }
+
+    start_ready_nodes();
+  }
+
+private:
+  using MINICOROS_STD::enable_shared_from_this<task_graph_state<T>>::shared_from_this;
+
+  /// Nodes only know their dependencies when they're added; derive the reverse edges in one array.
+  void link_dependents() {
+    for (task_graph_node<T>& node : nodes_) {
+      node.num_pending_dependencies = node.num_dependencies;
+      node.num_dependents = 0;
+    }
+
+    for (size_t dependency : dependencies_)
+      ++nodes_[dependency].num_dependents;
+
+    size_t offset = 0;
+
+    for (task_graph_node<T>& node : nodes_) {
+      node.first_dependent = offset;
+      node.num_pending_dependents = node.num_dependents;
+      offset += node.num_dependents;
+      node.num_dependents = 0;
+    }
+
+    dependents_.resize(offset);
+
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+      for (size_t d = 0; d < nodes_[i].num_dependencies; ++d) {
+        task_graph_node<T>& dependency = nodes_[dependencies_[nodes_[i].first_dependency + d]];
+        dependents_[dependency.first_dependent + dependency.num_dependents++] = i;
+      }
+    }
+  }
+
+  /// Nodes can only depend on nodes that were added before them, so walking backwards visits every node after its
+  /// dependents.
+  void compute_critical_paths() {
+    for (size_t i = nodes_.size(); i-- > 0;) {
+      uint64_t longest_tail = 0;
+
+      for (size_t d = 0; d < nodes_[i].num_dependents; ++d)
+        longest_tail = MINICOROS_STD::max(longest_tail, nodes_[dependents_[nodes_[i].first_dependent + d]].critical_path);
+
+      nodes_[i].critical_path = nodes_[i].estimated_cost + longest_tail;
+    }
+  }
+
+  void push_ready(size_t node) {
+    ready_.push_back(node);
+    MINICOROS_STD::push_heap(ready_.begin(), ready_.end(), critical_path_order{this});
+  }
+
+  /// Starts ready nodes, longest critical path first. Tasks that resolve synchronously make more nodes ready from
+  /// within this loop; the nested call returns right away and the loop picks them up, so deep graphs don't recurse.
+  void start_ready_nodes() {
+    if (starting_)
+      return;
+
+    starting_ = true;
+
+    while (!ready_.empty() && !failed_ && num_running_ < max_concurrency_) {
+      MINICOROS_STD::pop_heap(ready_.begin(), ready_.end(), critical_path_order{this});
+      const size_t index = ready_.back();
+      ready_.pop_back();
+
+      start_node(index);
+    }
+
+    starting_ = false;
+  }
+
+  void start_node(size_t index) {
+    task_graph_node<T>& node = nodes_[index];
+    ++num_running_;
+
+    future<T> result = node.task(task_inputs<T>{dependencies_.data() + node.first_dependency, node.num_dependencies, results_.data()});
+    node.task = {};
+
+    // The inputs have been handed over, release the ones that no other node is waiting for
+    for (size_t d = 0; d < node.num_dependencies; ++d) {
+      const size_t dependency = dependencies_[node.first_dependency + d];
+
+      if (--nodes_[dependency].num_pending_dependents == 0 && dependency != output_)
+        results_[dependency].reset();
+    }
+
+    MINICOROS_STD::move(result).chain().evaluate_into([state = shared_from_this(), index] (concrete_result<T>&& result) {
+      state->finish_node(index, MINICOROS_STD::move(result));
+    });
+  }
+
+  void finish_node(size_t index, concrete_result<T>&& result) {
+    --num_running_;
+
+    if (failed_)
+      return;
+
+    if (auto fail = result.get_failure()) {
+      failed_ = true;
+      resolve(concrete_result<T>{MINICOROS_STD::move(*fail)});
+      return;
+    }
+
+    task_graph_node<T>& node = nodes_[index];
+
+    if (node.num_dependents != 0 || index == output_)
+      results_[index].emplace(MINICOROS_STD::move(*result.get_value()));
+
+    for (size_t d = 0; d < node.num_dependents; ++d) {
+      const size_t dependent = dependents_[node.first_dependent + d];
+
+      if (--nodes_[dependent].num_pending_dependencies == 0)
+        push_ready(dependent);
+    }
+
+    if (++num_finished_ == nodes_.size()) {
+      resolve(concrete_result<T>{MINICOROS_STD::move(*results_[output_])});
+      return;
+    }
+
+    start_ready_nodes();
+  }
+
+  void resolve(concrete_result<T>&& result) {
+    MINICOROS_RECORD_EVENT(flight_event::combinator_joined, this);
+    auto promise = MINICOROS_STD::move(promise_);
+    promise_ = {};
+    promise(MINICOROS_STD::move(result));
+  }
+
+  struct critical_path_order {
+    const task_graph_state* state;
+
+    bool operator ()(size_t lhs, size_t rhs) const {
+      // Max-heap on the critical path; ties go to the node that was added first
+      const uint64_t lhs_path = state->nodes_[lhs].critical_path;
+      const uint64_t rhs_path = state->nodes_[rhs].critical_path;
+      return lhs_path < rhs_path || (lhs_path == rhs_path && lhs > rhs);
+    }
+  };
+
+  MINICOROS_STD::vector<task_graph_node<T>> nodes_;
+  MINICOROS_STD::vector<size_t> dependencies_;
+  MINICOROS_STD::vector<size_t> dependents_;
+  MINICOROS_STD::vector<MINICOROS_STD::optional<T>> results_;
+  MINICOROS_STD::vector<size_t> ready_;
+  size_t output_;
+  size_t max_concurrency_;
+  size_t num_running_ = 0;
+  size_t num_finished_ = 0;
+  bool starting_ = false;
+  bool failed_ = false;
+  promise<T> promise_;
+};
+
+} // detail
+
+/// A DAG of steps whose edges carry results. Each node is a function that receives the results of its dependencies
+/// and returns a future; it's started as soon as all of its dependencies have resolved. When several nodes are ready
+/// at once (or `max_concurrency` holds them back), the one with the longest estimated critical path (its own cost
+/// plus that of the costliest chain of dependents) goes first, so the steps that bound the total latency aren't
+/// stuck behind cheap ones.
+///
+/// Compared to nesting `&&`s, the whole run shares one state and results are handed along edges by index rather
+/// than through a shared state per join. A result is released as soon as its last dependent has started.
+///
+/// ```cpp
+/// mc::task_graph<relation> plan;
+/// auto users = plan.add_node([] (auto) { return scan("users"); }, {}, 50);
+/// auto orders = plan.add_node([] (auto) { return scan("orders"); }, {}, 400);
+/// auto joined = plan.add_node([] (mc::task_inputs<relation> in) { return hash_join(in[0], in[1]); }, {users, orders}, 100);
+///
+/// std::move(plan).run(joined).then([] (relation result) { ... });
+/// ```
+///
+/// If a node fails, the graph fails with that failure and no further nodes are started. Nodes can only depend on
+/// nodes that were added before them, which rules out cycles. Not thread-safe: nodes should resolve on the thread
+/// that runs the graph, just like with the combinators.
+template<typename T>
+class task_graph {
+public:
+  static_assert(!MINICOROS_STD::is_void_v<T>, "task_graph nodes have to produce a value");
+
+  using node_id = size_t;
+  using task_type = MINICOROS_FUNCTION_TYPE<future<T>(task_inputs<T>)>;
+
+  /// Adds a node that runs `task` once `dependencies` have resolved. `estimated_cost` is in arbitrary units (say,
+  /// microseconds) and only matters relative to the other nodes.
+  node_id add_node(task_type&& task, MINICOROS_STD::initializer_list<node_id> dependencies = {}, uint64_t estimated_cost = 1) {
+    return add_node<MINICOROS_STD::initializer_list<node_id>>(MINICOROS_STD::move(task), dependencies, estimated_cost);
+  }
+
+  /// Same as above, for dependencies that are only known at runtime: any range of `node_id`s, such as a vector.
+  template<typename RangeType>
+  node_id add_node(task_type&& task, const RangeType& dependencies, uint64_t estimated_cost = 1) {
+    const node_id id = nodes_.size();
+    const size_t first_dependency = dependencies_.size();
+
+    for (node_id dependency : dependencies) {
+      assert(dependency < id && "task_graph nodes can only depend on nodes that were added before them");
+      dependencies_.push_back(dependency);
+    }
+
+    nodes_.push_back(detail::task_graph_node<T>{MINICOROS_STD::move(task), estimated_cost, first_dependency, dependencies_.size() - first_dependency, 0, 0, 0, 0, 0});
+    return id;
+  }
+
+  /// Limits the number of nodes that are running at the same time. Unlimited by default.
+  void set_max_concurrency(size_t max_concurrency) {
+    assert(max_concurrency > 0 && "max_concurrency has to be at least 1");
+    max_concurrency_ = max_concurrency;
+  }
+
+  size_t size() const {
+    return nodes_.size();
+  }
+
+  /// Returns a future that runs the whole graph and resolves with the result of `output` once every node has
+  /// finished.
+  future<T> run(node_id output) && {
+    assert(output < nodes_.size() && "unknown output node");
+
+    return future<T>([nodes = MINICOROS_STD::move(nodes_), dependencies = MINICOROS_STD::move(dependencies_), output, max_concurrency = max_concurrency_] (promise<T>&& p) mutable {
+      detail::make_shared_state<detail::task_graph_state<T>>(MINICOROS_STD::move(nodes), MINICOROS_STD::move(dependencies), output, max_concurrency, MINICOROS_STD::move(p))->start();
+    });
+  }
+
+private:
+  MINICOROS_STD::vector<detail::task_graph_node<T>> nodes_;
+  MINICOROS_STD::vector<size_t> dependencies_;
+  size_t max_concurrency_ = SIZE_MAX;
+};
+
+} // mc
+
+#endif // MINICOROS_TASK_GRAPH_H_
@@ -0,0 +1,231 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#ifndef MINICOROS_TASK_SCOPE_H_
+#define MINICOROS_TASK_SCOPE_H_
+
+#ifdef MINICOROS_CUSTOM_INCLUDE
+  #include MINICOROS_CUSTOM_INCLUDE
+#endif
+
+#include <minicoros/future.h>
+#include <minicoros/context.h>
+#include <minicoros/detail/operation_helpers.h>
+
+#ifdef MINICOROS_USE_EASTL
+  #include <eastl/optional.h>
+  #include <eastl/shared_ptr.h>
+  #include <cassert>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD eastl
+  #endif
+#else
+  #include <optional>
+  #include <memory>
+  #include <cassert>
+
+  #ifndef MINICOROS_STD
+    #define MINICOROS_STD std
+  #endif
+#endif
+
+namespace mc {
+
+namespace detail {
+
+/// State shared between a `task_scope` and all of its children. Counts the children that haven't finished yet and
+/// remembers the first failure until `join` picks it up. The children are cancelled once neither the scope nor a
+/// pending join is left to wait for them.
+class scope_state {
+public:
+  explicit scope_state(MINICOROS_ERROR_TYPE&& cancelled_error) : context_(make_context(MINICOROS_STD::move(cancelled_error))) {}
+
+  /// The context that the scope's children are created in. Cancelling it cancels them.
+  const context_ptr& get_context() const {
+    return context_;
+  }
+
+  void add_child() {
+    ++num_pending_children_;
+  }
+
+  template<typename T>
+  void finish_child(concrete_result<T>&& result) {
+    if (!result.success() && !failure_)
+      failure_.emplace(MINICOROS_STD::move(*result.get_failure()));
+
+    --num_pending_children_;
+    resolve_if_done();
+  }
+
+  /// Counts a join from the time it's requested until it has resolved or its future has been dropped.
+  void add_join() {
+    ++num_pending_joins_;
+  }
+
+  void release_join() {
+    --num_pending_joins_;
+    cancel_if_abandoned();
+  }
+
+  void release_scope() {
+    scope_alive_ = false;
+    cancel_if_abandoned();
+  }
+
+  /// Takes over the join that was added for the promise's future; it's released once the promise has been resolved.
+  void attach(promise<void>&& p) {
+    assert(!promise_ && "a task_scope can only be joined once at a time");
+    promise_ = MINICOROS_STD::move(p);
+    resolve_if_done();
+  }
+
+private:
+  void cancel_if_abandoned() {
+    if (!scope_alive_ && num_pending_joins_ == 0)
+      context_->cancel();
+  }
+
+  void resolve_if_done() {
+    if (num_pending_children_ != 0 || !promise_)
+      return;
+
+    MINICOROS_RECORD_EVENT(flight_event::combinator_joined, this);
+    auto promise = MINICOROS_STD::move(promise_);
+    promise_ = {};
+    release_join();
+
+    if (failure_) {
+      failure f{MINICOROS_STD::move(*failure_)};
+      failure_.reset();
+      promise(concrete_result<void>{MINICOROS_STD::move(f)});
+      return;
+    }
+
+    promise(concrete_result<void>{});
+  }
+
+  context_ptr context_;
+  size_t num_pending_children_ = 0;
+  size_t num_pending_joins_ = 0;
+  bool scope_alive_ = true;
+  MINICOROS_STD::optional<failure> failure_;
+  promise<void> promise_;
+};
+
+/// Captured by the future that `join` returns, holds that join's count until the future is evaluated or dropped.
+class scope_joiner {
+public:
+  explicit scope_joiner(const MINICOROS_STD::shared_ptr<scope_state>& state) : state_(state) {
+    state_->add_join();
+  }
+
+  scope_joiner(scope_joiner&& other) : state_(MINICOROS_STD::move(other.state_)) {}
+
+  scope_joiner(const scope_joiner& other) : state_(other.state_) {
+    if (state_)
+      state_->add_join();
+  }
+
+  scope_joiner& operator=(const scope_joiner&) = delete;
+
+  ~scope_joiner() {
+    if (state_)
+      state_->release_join();
+  }
+
+  /// Hands the join's count over to the promise.
+  void attach(promise<void>&& p) {
+    MINICOROS_STD::shared_ptr<scope_state> state = MINICOROS_STD::move(state_);
+    state_ = {};
+    state->attach(MINICOROS_STD::move(p));
+  }
+
+private:
+  MINICOROS_STD::shared_ptr<scope_state> state_;
+};
+
+} // detail
+
+/// Owns a group of background futures. Children are started as soon as they're spawned, and `join` returns a
+/// future that resolves once every child has finished. If any child fails, `join` fails with the first failure;
+/// the other children still run to completion.
+///
+/// The scope owns a context (see `mc::context`) that its children are created in. Cancelling the scope cancels that
+/// context: the children that are still running skip their remaining `.then` stages and fail with `cancelled_error`,
+/// which releases their handlers as they unwind. Destroying the scope cancels it too, unless a join is pending: the
+/// future that `join` returns keeps the children running until it has resolved, or until it's dropped without
+/// having been evaluated. Cancellation takes effect at stage
+/// boundaries, so a child that's waiting on a promise finishes once that promise is resolved (or dropped). Children
+/// are created in the scope's own context rather than the caller's, so they don't inherit its deadline or
+/// `async_local` values.
+///
+/// All children share one state that's allocated together with the scope, so spawning doesn't allocate anything
+/// beyond what the child future itself needs. The state is released when the last child has finished and the
+/// scope is gone. Results of successful children are discarded; use `when_all` if you need them.
+///
+/// ```cpp
+/// mc::task_scope scope{ECANCELED};
+/// scope.spawn([&] { return write_audit_log(request); });
+/// scope.spawn([&] { return update_stats(request); });
+///
+/// return scope.join(); // Resolves once both are done, even though `scope` goes away here
+/// ```
+///
+/// Not thread-safe: children should resolve on the thread that owns the scope, just like with the combinators.
+class task_scope {
+public:
+  explicit task_scope(MINICOROS_ERROR_TYPE&& cancelled_error)
+    : state_(detail::make_shared_state<detail::scope_state>(MINICOROS_STD::move(cancelled_error))) {}
+
+  task_scope(const task_scope&) = delete;
+  task_scope& operator=(const task_scope&) = delete;
+
+  /// Cancels the children that are still running, unless a join is pending.
+  ~task_scope() {
+    state_->release_scope();
+  }
+
+  /// Creates a child by calling `make_child` within the scope's context and starts evaluating it. `make_child`
+  /// returns a future.
+  template<typename CallbackType>
+  void spawn(CallbackType&& make_child) {
+    context_scope scope{state_->get_context()};
+    spawn(MINICOROS_STD::forward<CallbackType>(make_child)());
+  }
+
+  /// Starts evaluating a future as a child of the scope. The future keeps the context it was created in, so only
+  /// its stages that are created within the scope's context (eg, by a `spawn` callback) are cancelled with the scope.
+  template<typename T>
+  void spawn(future<T>&& fut) {
+    state_->add_child();
+
+    MINICOROS_STD::move(fut).chain().evaluate_into([state = state_] (concrete_result<T>&& result) {
+      state->finish_child(MINICOROS_STD::move(result));
+    });
+  }
+
+  /// Makes the children that are still running fail at their next stage, as do the children spawned afterwards.
+  void cancel() {
+    state_->get_context()->cancel();
+  }
+
+  bool cancelled() const {
+    return state_->get_context()->cancelled();
+  }
+
+  /// Returns a future that resolves once all children (including those spawned after `join`) have finished.
+  /// The scope can be reused after the join has resolved, unless it has been cancelled.
+  future<void> join() {
+    return future<void>([joiner = detail::scope_joiner{state_}] (promise<void>&& p) mutable {
+      joiner.attach(MINICOROS_STD::move(p));
+    });
+  }
+
+private:
+  MINICOROS_STD::shared_ptr<detail::scope_state> state_;
+};
+
+} // mc
+
+#endif // MINICOROS_TASK_SCOPE_H_
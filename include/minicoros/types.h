@@ -38,130 +38,83 @@
 namespace mc {
 namespace detail {
 
-class untyped_declval
-{
-public:
-  template<typename T>
-  operator T() const {
-    return MINICOROS_STD::declval<T>();
-  }
-};
-
-// TODO: we shouldn't try to pry a return type from the lambda. We should instead invert the flow.
-template<typename LambdaType>
-auto return_type(LambdaType&& lambda) -> decltype(lambda(untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}));
-
-template<typename LambdaType>
-auto return_type(LambdaType&& lambda) -> decltype(lambda(untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}));
-
-template<typename LambdaType>
-auto return_type(LambdaType&& lambda) -> decltype(lambda(untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}));
-
-template<typename LambdaType>
-auto return_type(LambdaType&& lambda) -> decltype(lambda(untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}));
-
-template<typename LambdaType>
-auto return_type(LambdaType&& lambda) -> decltype(lambda(untyped_declval{}, untyped_declval{}, untyped_declval{}, untyped_declval{}));
-
-template<typename LambdaType>
-auto return_type(LambdaType&& lambda) -> decltype(lambda(untyped_declval{}, untyped_declval{}, untyped_declval{}));
-
-template<typename LambdaType>
-auto return_type(LambdaType&& lambda) -> decltype(lambda(untyped_declval{}, untyped_declval{}));
-
-template<typename LambdaType>
-auto return_type(LambdaType&& lambda) -> decltype(lambda(untyped_declval{}));
-
-template<typename LambdaType>
-auto return_type(LambdaType&& lambda) -> decltype(lambda());
+template<typename T>
+struct is_tuple : public MINICOROS_STD::false_type {};
 
-template <typename LambdaType>
-struct lambda_helper_impl;
+template<typename... Ts>
+struct is_tuple<MINICOROS_STD::tuple<Ts...>> : public MINICOROS_STD::true_type {};
 
-template <typename Ret, typename F, typename... Args>
-struct lambda_helper_impl<Ret(F::*)(Args...) const> {
-  using return_type = Ret;
-  static constexpr int num_arguments = sizeof...(Args);
-};
+template<typename Void, typename CallbackType, typename... ArgTypes>
+struct is_callable_impl : public MINICOROS_STD::false_type {};
 
-template <typename Ret, typename F, typename... Args>
-struct lambda_helper_impl<Ret(F::*)(Args...)> {
-  using return_type = Ret;
-  static constexpr int num_arguments = sizeof...(Args);
-};
+template<typename CallbackType, typename... ArgTypes>
+struct is_callable_impl<decltype(void(MINICOROS_STD::declval<CallbackType>()(MINICOROS_STD::declval<ArgTypes>()...))), CallbackType, ArgTypes...> : public MINICOROS_STD::true_type {};
 
-template <typename LambdaType, typename = void>
-struct lambda_helper : lambda_helper_impl<LambdaType> {};
+/// Whether the callback can be invoked with the given argument types. Generic lambdas are only instantiated
+/// for argument counts they accept.
+template<typename CallbackType, typename... ArgTypes>
+constexpr bool is_callable_v = is_callable_impl<void, CallbackType, ArgTypes...>::value;
 
-template <typename LambdaType>
-struct lambda_helper<LambdaType, decltype(void(&LambdaType::operator()))> : lambda_helper_impl<decltype(&LambdaType::operator())> {};
+template<typename CallbackType, typename Tuple, typename Indexes>
+struct is_callable_with_prefix;
 
-/// Helper for counting the number of arguments a callable (most often a lambda in our case) takes
-template<typename LambdaType>
-struct num_arguments_helper {};
+template<typename CallbackType, typename... Ts, size_t... Indexes>
+struct is_callable_with_prefix<CallbackType, MINICOROS_STD::tuple<Ts...>, MINICOROS_STD::index_sequence<Indexes...>>
+  : public MINICOROS_STD::bool_constant<is_callable_v<CallbackType, MINICOROS_STD::tuple_element_t<Indexes, MINICOROS_STD::tuple<Ts...>>&&...>> {};
 
-template<typename ReturnType, typename... ArgTypes, typename F>
-struct num_arguments_helper<ReturnType (F::*)(ArgTypes...)> {
-  static constexpr int num_arguments = sizeof...(ArgTypes);
-};
+/// The number of leading tuple elements the callback takes. The callback is probed with the actual value types,
+/// starting with all of them and dropping one at a time, so the probing stops at the first arity that works.
+template<typename CallbackType, typename Tuple, size_t Count>
+struct tuple_arity : public MINICOROS_STD::conditional_t<
+  is_callable_with_prefix<CallbackType, Tuple, MINICOROS_STD::make_index_sequence<Count>>::value,
+  MINICOROS_STD::integral_constant<size_t, Count>,
+  tuple_arity<CallbackType, Tuple, Count - 1>> {};
 
-template<typename ReturnType, typename... ArgTypes, typename F>
-struct num_arguments_helper<ReturnType (F::*)(ArgTypes...) const> {
-  static constexpr int num_arguments = sizeof...(ArgTypes);
+template<typename CallbackType, typename Tuple>
+struct tuple_arity<CallbackType, Tuple, 0> : public MINICOROS_STD::integral_constant<size_t, 0> {
+  static_assert(is_callable_v<CallbackType>, "Callback can't be invoked with the resulting values of the future");
 };
 
-template<size_t... Indexes, typename... Ts>
-auto truncate_tuple_impl(MINICOROS_STD::index_sequence<Indexes...>, MINICOROS_STD::tuple<Ts...> t) {
-  return MINICOROS_STD::make_tuple(MINICOROS_STD::get<Indexes>(t)...);
-}
-
-/// Returns the first MaxCount elements of the given tuple
-template<size_t MaxCount, typename... Ts>
-auto truncate_tuple(MINICOROS_STD::tuple<Ts...>&& t) {
-  static_assert(MaxCount <= sizeof...(Ts), "cannot take that many elements from the given tuple");
-  return truncate_tuple_impl(MINICOROS_STD::make_index_sequence<MaxCount>(), t);
+template<typename CallbackType, typename... Ts, size_t... Indexes>
+decltype(auto) apply_prefix(CallbackType& callback, MINICOROS_STD::tuple<Ts...>&& t, MINICOROS_STD::index_sequence<Indexes...>) {
+  (void)t;
+  return callback(MINICOROS_STD::get<Indexes>(MINICOROS_STD::move(t))...);
 }
 
-/// Similar to std::apply but tries to apply as many arguments as the receiver takes. It also
-/// supports a single non-tuple value.
+/// Invokes the callback with the value of a future. Tuples are unpacked, and the callback may take fewer
+/// values than the tuple holds; the trailing values are dropped.
 /// Partial application was measured at one point to cost about ~4% more in test_compile_duration.
-/// This specialization is for calling an n-ary lambda using an m-ary tuple where m >= n
-template<typename LambdaType, typename... TupleArguments>
-auto partial_call(LambdaType&& lambda, MINICOROS_STD::tuple<TupleArguments...>&& t) {
-  auto truncated_tuple = truncate_tuple<detail::lambda_helper<LambdaType>::num_arguments>(MINICOROS_STD::move(t));
-  return MINICOROS_STD::apply(MINICOROS_STD::forward<LambdaType>(lambda), MINICOROS_STD::move(truncated_tuple));
-}
+template<typename CallbackType, typename T>
+decltype(auto) partial_call(CallbackType& callback, T&& value) {
+  using ValueType = MINICOROS_STD::remove_reference_t<T>;
 
-/// Specialization for calling a 1-ary lambda using a single value.
-template<typename LambdaType, typename T>
-auto partial_call(LambdaType&& lambda, T&& t) -> decltype(lambda(MINICOROS_STD::move(t))) {
-  return MINICOROS_STD::invoke(MINICOROS_STD::forward<LambdaType>(lambda), MINICOROS_STD::move(t));
-}
-
-/// Specialization for calling a 0-ary lambda using a single value.
-template<typename LambdaType, typename T>
-auto partial_call(LambdaType&& lambda, T&&) -> decltype(lambda()) {
-  return lambda();
+  if constexpr (is_tuple<ValueType>::value) {
+    constexpr size_t arity = tuple_arity<CallbackType&, ValueType, MINICOROS_STD::tuple_size<ValueType>::value>::value;
+    return apply_prefix(callback, MINICOROS_STD::move(value), MINICOROS_STD::make_index_sequence<arity>());
+  }
+  else if constexpr (is_callable_v<CallbackType&, ValueType&&>) {
+    return callback(MINICOROS_STD::move(value));
+  }
+  else {
+    static_assert(is_callable_v<CallbackType&>, "Callback can't be invoked with the resulting value of the future");
+    (void)value;
+    return callback();
+  }
 }
 
-template<typename LambdaType, typename... TupleArguments>
-void partial_call_no_return(LambdaType&& lambda, MINICOROS_STD::tuple<TupleArguments...>&& t) {
-  auto truncated_tuple = truncate_tuple<detail::lambda_helper<LambdaType>::num_arguments>(MINICOROS_STD::move(t));
-  MINICOROS_STD::apply(MINICOROS_STD::forward<LambdaType>(lambda), MINICOROS_STD::move(truncated_tuple));
-}
+/// The type returned by a `.then` callback when invoked with the value of a `future<T>`.
+template<typename CallbackType, typename T>
+struct callback_result {
+  using type = decltype(partial_call(MINICOROS_STD::declval<MINICOROS_STD::decay_t<CallbackType>&>(), MINICOROS_STD::declval<T>()));
+};
 
-/// Specialization for calling a 1-ary lambda using a single value.
-template<typename LambdaType, typename T>
-auto partial_call_no_return(LambdaType&& lambda, T&& t) -> decltype((void)lambda(MINICOROS_STD::move(t))) {
-  MINICOROS_STD::invoke(MINICOROS_STD::forward<LambdaType>(lambda), MINICOROS_STD::move(t));
-}
+template<typename CallbackType>
+struct callback_result<CallbackType, void> {
+  using type = decltype(MINICOROS_STD::declval<MINICOROS_STD::decay_t<CallbackType>&>()());
+};
 
-/// Specialization for calling a 0-ary lambda using a single value.
-template<typename LambdaType, typename T>
-auto partial_call_no_return(LambdaType&& lambda, T&& t) -> decltype((void)lambda()) {
-  (void)t;
-  lambda();
-}
+template<typename CallbackType, typename T>
+using callback_result_t = typename callback_result<CallbackType, T>::type;
 
 }
 
@@ -186,17 +139,17 @@ public:
   /// Invokes the callback with this result and resolves the promise using the return value
   /// from the callback.
   template<typename CallbackType, typename PromiseType>
-  auto resolve_promise_with_callback(CallbackType&& callback, PromiseType&& promise) -> MINICOROS_STD::enable_if_t<!MINICOROS_STD::is_void<typename detail::lambda_helper<CallbackType>::return_type>::value> {
-    // General case for handling callbacks that return mc::result<T>
-    detail::partial_call(MINICOROS_STD::forward<CallbackType>(callback), MINICOROS_STD::move(*MINICOROS_STD::get_if<type>(&value_)))
-      .resolve_promise(MINICOROS_STD::move(promise));
-  }
-
-  template<typename CallbackType, typename PromiseType>
-  auto resolve_promise_with_callback(CallbackType&& callback, PromiseType&& promise) -> MINICOROS_STD::enable_if_t<MINICOROS_STD::is_void<typename detail::lambda_helper<CallbackType>::return_type>::value> {
-    // Callbacks are allowed to return void, and for those we need some special handling
-    detail::partial_call_no_return(MINICOROS_STD::forward<CallbackType>(callback), MINICOROS_STD::move(*MINICOROS_STD::get_if<type>(&value_)));
-    MINICOROS_STD::move(promise)({}); // Only going to be used for future<void> since we infer the type from the lambda
+  void resolve_promise_with_callback(CallbackType& callback, PromiseType&& promise) {
+    if constexpr (MINICOROS_STD::is_void_v<detail::callback_result_t<CallbackType, type>>) {
+      // Callbacks are allowed to return void, and for those we need some special handling
+      detail::partial_call(callback, MINICOROS_STD::move(*MINICOROS_STD::get_if<type>(&value_)));
+      MINICOROS_STD::move(promise)({}); // Only going to be used for future<void> since we infer the type from the lambda
+    }
+    else {
+      // General case for handling callbacks that return mc::result<T>
+      detail::partial_call(callback, MINICOROS_STD::move(*MINICOROS_STD::get_if<type>(&value_)))
+        .resolve_promise(MINICOROS_STD::move(promise));
+    }
   }
 
   bool success() const {
@@ -226,17 +179,17 @@ public:
   concrete_result(failure&& f) : failure_(MINICOROS_STD::move(f)) {}
 
   template<typename CallbackType, typename PromiseType>
-  auto resolve_promise_with_callback(CallbackType&& callback, PromiseType&& promise) -> MINICOROS_STD::enable_if_t<!MINICOROS_STD::is_void<decltype(callback())>::value> {
-    // General case for handling callbacks that return mc::result<T>
-    callback()
-      .resolve_promise(MINICOROS_STD::move(promise));
-  }
-
-  template<typename CallbackType, typename PromiseType>
-  auto resolve_promise_with_callback(CallbackType&& callback, PromiseType&& promise) -> MINICOROS_STD::enable_if_t<MINICOROS_STD::is_void<decltype(callback())>::value> {
-    // Callbacks are allowed to return void, and for those we need some special handling
-    callback();
-    MINICOROS_STD::move(promise)({});
+  void resolve_promise_with_callback(CallbackType& callback, PromiseType&& promise) {
+    if constexpr (MINICOROS_STD::is_void_v<decltype(callback())>) {
+      // Callbacks are allowed to return void, and for those we need some special handling
+      callback();
+      MINICOROS_STD::move(promise)({});
+    }
+    else {
+      // General case for handling callbacks that return mc::result<T>
+      callback()
+        .resolve_promise(MINICOROS_STD::move(promise));
+    }
   }
 
   bool success() const {
@@ -260,9 +213,28 @@ struct is_concrete_result<mc::concrete_result<T>> : public MINICOROS_STD::true_t
 template<typename T>
 constexpr bool is_concrete_result_v = is_concrete_result<T>::value;
 
+/// Resolves a future. Invoke it once: a second invocation asserts, and is ignored in release builds, once the future
+/// has a stage (`.then`, `.fail`, etc). The promise of a future without stages is the sink of whoever evaluates it,
+/// which is only guarded against a second invocation with `MINICOROS_BROKEN_PROMISE_ERROR`; guarding it always would
+/// cost an allocation per evaluated future.
 template<typename ResultType>
 using promise = continuation<concrete_result<ResultType>>;
 
+#ifdef MINICOROS_BROKEN_PROMISE_ERROR
+namespace detail {
+
+template<typename T>
+struct broken_promise_result<concrete_result<T>> {
+  static constexpr bool supported = true;
+
+  static concrete_result<T> make() {
+    return concrete_result<T>{failure{MINICOROS_ERROR_TYPE{MINICOROS_BROKEN_PROMISE_ERROR}}};
+  }
+};
+
+} // detail
+#endif
+
 } // mc
 
 #endif // MINICOROS_TYPES_H_
@@ -0,0 +1,103 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+/// C++20 named module for Minicoros. Importing a prebuilt module interface avoids reparsing the headers
+/// and their standard library dependencies in every translation unit.
+///
+/// The configuration macros (`MINICOROS_USE_EASTL`, `MINICOROS_STD`, `MINICOROS_ERROR_TYPE`, etc) apply
+/// when the module interface is built, and importers have to agree with them. `<minicoros/minicoros.h>`
+/// checks this when `MINICOROS_USE_MODULES` is defined.
+
+module;
+
+#include <minicoros/future.h>
+#include <minicoros/operations.h>
+#include <minicoros/task_scope.h>
+#include <minicoros/promise_pair.h>
+#include <minicoros/microtask_queue.h>
+#include <minicoros/task_graph.h>
+#include <minicoros/async_memo.h>
+#include <minicoros/rate_limiter.h>
+#include <minicoros/pool.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+  #include <minicoros/fiber.h>
+#endif
+
+export module minicoros;
+
+export namespace mc {
+
+using mc::continuation;
+using mc::continuation_chain;
+using mc::failure;
+using mc::concrete_result;
+using mc::is_concrete_result;
+using mc::is_concrete_result_v;
+using mc::promise;
+using mc::result;
+using mc::future;
+using mc::make_successful_future;
+using mc::make_failed_future;
+using mc::when_all;
+using mc::when_any;
+using mc::when_seq;
+using mc::when_all_until;
+using mc::spawn;
+using mc::task_scope;
+using mc::context;
+using mc::context_ptr;
+using mc::context_scope;
+using mc::make_context;
+using mc::current_context;
+using mc::async_local;
+using mc::quota_allocator;
+using mc::stage_budget;
+using mc::yield;
+using mc::promise_handle;
+using mc::promise_slot;
+using mc::make_promise_future_pair;
+using mc::resolve_c_user_data;
+using mc::c_trampoline;
+using mc::microtask_queue;
+using mc::task_graph;
+using mc::task_inputs;
+using mc::async_memo;
+using mc::rate_limiter;
+using mc::pool;
+using mc::pool_allocator;
+using mc::pooled_function;
+
+#if defined(__unix__) || defined(__APPLE__)
+using mc::fiber;
+using mc::await;
+using mc::run_in_fiber;
+#endif
+
+#ifdef MINICOROS_ENABLE_FLIGHT_RECORDER
+using mc::flight_event;
+using mc::flight_recorder;
+#endif
+
+#ifdef MINICOROS_ENABLE_CPU_ACCOUNTING
+using mc::cpu_accounting;
+#endif
+
+#ifdef MINICOROS_ENABLE_ASYNC_FRAMES
+using mc::async_location;
+using mc::async_frame;
+using mc::current_async_frame;
+using mc::print_async_stack;
+#endif
+
+namespace config {
+
+#ifdef MINICOROS_USE_EASTL
+inline constexpr bool uses_eastl = true;
+#else
+inline constexpr bool uses_eastl = false;
+#endif
+
+using error_type = MINICOROS_ERROR_TYPE;
+
+} // config
+
+} // mc
@@ -0,0 +1,35 @@
+#!/bin/bash
+# Generates a translation unit with a single chain of N `.then` stages (default 1000) for measuring how
+# compile time and compiler memory scale with chain length:
+#   ./gen_compile_duration.sh 1000 > test_compile_duration_long.cpp
+
+stages=${1:-1000}
+
+cat <<HEADER
+/// Generated by gen_compile_duration.sh; $stages stages.
+
+#include <minicoros/future.h>
+
+int main()
+{
+  int result = 0;
+
+  mc::make_successful_future<int>(0)
+HEADER
+
+for ((i = 0; i < stages; ++i)); do
+  case $((i % 4)) in
+    0) echo "    .then([](int value) -> mc::result<int> { return value + 1; })" ;;
+    1) echo "    .then([](int value) -> mc::result<int> { return mc::make_successful_future<int>(value + 1); })" ;;
+    2) echo "    .fail([](int error) { return mc::failure(error + 1); })" ;;
+    3) echo "    .then([](int value) -> mc::result<int> { if (value < 0) return mc::failure(-value); return value + 1; })" ;;
+  esac
+done
+
+cat <<FOOTER
+    .then([&result](int value) { result = value; })
+    .ignore_result();
+
+  return result == $(( stages - (stages + 1) / 4 )) ? 0 : 1;
+}
+FOOTER
@@ -0,0 +1,8 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#include "instantiated_futures.h"
+
+MINICOROS_INSTANTIATE_FUTURE(void)
+MINICOROS_INSTANTIATE_FUTURE(int)
+MINICOROS_INSTANTIATE_FUTURE(std::string)
+MINICOROS_INSTANTIATE_FUTURE(std::tuple<int, std::string>)
@@ -0,0 +1,16 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+/// Future types shared by the tests, instantiated once in instantiated_futures.cpp.
+
+#ifndef MINICOROS_TEST_INSTANTIATED_FUTURES_H_
+#define MINICOROS_TEST_INSTANTIATED_FUTURES_H_
+
+#include <minicoros/instantiation.h>
+#include <string>
+#include <tuple>
+
+MINICOROS_DECLARE_FUTURE(void)
+MINICOROS_DECLARE_FUTURE(int)
+MINICOROS_DECLARE_FUTURE(std::string)
+MINICOROS_DECLARE_FUTURE(std::tuple<int, std::string>)
+
+#endif // MINICOROS_TEST_INSTANTIATED_FUTURES_H_
@@ -0,0 +1,74 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+/// Built separately (`make async_frames`) since MINICOROS_ENABLE_ASYNC_FRAMES has to be set for every
+/// translation unit that uses minicoros.
+
+#include "testing.h"
+#include <minicoros/operations.h>
+#include <minicoros/testing.h>
+#include <cstring>
+
+using namespace testing;
+using namespace mc;
+
+namespace {
+
+bool is_this_file(const async_location& location) {
+  return std::strstr(location.file, "test_async_frames.cpp") != nullptr;
+}
+
+} // namespace
+
+TEST(async_frames, no_frame_outside_of_stages) {
+  ASSERT_EQ(current_async_frame(), nullptr);
+}
+
+TEST(async_frames, stage_records_where_it_was_attached) {
+  unsigned depth = 0;
+  unsigned line = 0;
+  unsigned expected_line = __LINE__ + 2;
+
+  make_successful_future<int>(1).then([&] (int) {
+    depth = current_async_frame()->depth;
+    line = current_async_frame()->locations[0].line;
+    ASSERT_TRUE(is_this_file(current_async_frame()->locations[0]));
+  }).ignore_result();
+
+  ASSERT_EQ(depth, 1);
+  ASSERT_EQ(line, expected_line);
+  ASSERT_EQ(current_async_frame(), nullptr);
+}
+
+TEST(async_frames, nested_chains_link_to_the_stage_that_created_them) {
+  promise<int> p;
+  async_frame seen;
+  unsigned outer_line = __LINE__ + 2;
+
+  make_successful_future<int>(1).then([&] (int) -> result<int> {
+    unsigned inner_line = __LINE__ + 1;
+    return future<int>([&] (promise<int> inner) { p = std::move(inner); }).then([&, inner_line] (int value) -> result<int> {
+      seen = *current_async_frame();
+      ASSERT_EQ(seen.locations[0].line, inner_line);
+      return value;
+    });
+  }).ignore_result();
+
+  p(123); // Resolved from outside of any stage
+  ASSERT_EQ(seen.depth, 2);
+  ASSERT_EQ(seen.locations[1].line, outer_line);
+}
+
+TEST(async_frames, deep_stacks_are_truncated) {
+  int depth = 0;
+
+  std::function<future<int>(int)> recurse = [&] (int n) -> future<int> {
+    if (n == 0) {
+      depth = static_cast<int>(current_async_frame()->depth);
+      return make_successful_future<int>(0);
+    }
+
+    return make_successful_future<int>(n - 1).then([&] (int next) -> result<int> { return recurse(next); });
+  };
+
+  recurse(MINICOROS_ASYNC_FRAME_DEPTH * 2).ignore_result();
+  ASSERT_EQ(depth, MINICOROS_ASYNC_FRAME_DEPTH);
+}
@@ -0,0 +1,111 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#include "testing.h"
+#include <minicoros/async_memo.h>
+#include <minicoros/testing.h>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+using namespace mc;
+
+TEST(async_memo, caches_the_value) {
+  int num_loads = 0;
+  async_memo<int> memo{[&] {
+    ++num_loads;
+    return make_successful_future<int>(5);
+  }};
+
+  assert_successful_result_eq(memo.get(), 5);
+  assert_successful_result_eq(memo.get(), 5);
+  ASSERT_EQ(num_loads, 1);
+}
+
+TEST(async_memo, concurrent_readers_share_the_computation) {
+  promise<int> pending;
+  async_memo<int> memo{[&] {
+    return future<int>([&] (promise<int>&& p) { pending = std::move(p); });
+  }};
+
+  std::vector<int> values;
+  memo.get().then([&] (int value) { values.push_back(value); }).ignore_result();
+  memo.get().then([&] (int value) { values.push_back(value); }).ignore_result();
+
+  ASSERT_TRUE(memo.computing());
+  ASSERT_EQ(memo.num_computations(), 1);
+
+  pending(7);
+  ASSERT_EQ(values.size(), 2);
+  ASSERT_EQ(values[0], 7);
+  ASSERT_EQ(values[1], 7);
+}
+
+TEST(async_memo, invalidation_recomputes_only_dependent_nodes) {
+  int source_value = 1;
+  async_memo<int> source{[&] { return make_successful_future<int>(int{source_value}); }};
+  async_memo<int> unrelated{[] { return make_successful_future<int>(100); }};
+  async_memo<int> doubled{[source] {
+    return source.get().then([] (int value) -> result<int> { return value * 2; });
+  }, {source}};
+  async_memo<int> total{[doubled, unrelated] {
+    return (doubled.get() && unrelated.get()).then([] (int a, int b) -> result<int> { return a + b; });
+  }, {doubled, unrelated}};
+
+  assert_successful_result_eq(total.get(), 102);
+
+  source_value = 2;
+  source.invalidate();
+  ASSERT_FALSE(doubled.has_value());
+  ASSERT_FALSE(total.has_value());
+  ASSERT_TRUE(unrelated.has_value());
+
+  assert_successful_result_eq(total.get(), 104);
+  ASSERT_EQ(source.num_computations(), 2);
+  ASSERT_EQ(doubled.num_computations(), 2);
+  ASSERT_EQ(unrelated.num_computations(), 1);
+}
+
+TEST(async_memo, invalidation_during_computation_restarts_it) {
+  std::vector<promise<int>> pending;
+  int version = 1;
+  async_memo<int> memo{[&] {
+    return future<int>([&] (promise<int>&& p) { pending.push_back(std::move(p)); });
+  }};
+
+  int value = 0;
+  memo.get().then([&] (int result) { value = result; }).ignore_result();
+
+  memo.invalidate();
+  pending[0](int{version++});
+  ASSERT_EQ(value, 0); // Outdated, recomputing
+
+  ASSERT_EQ(pending.size(), 2);
+  pending[1](int{version++});
+  ASSERT_EQ(value, 2);
+}
+
+TEST(async_memo, failures_arent_cached) {
+  int num_loads = 0;
+  async_memo<int> memo{[&] {
+    return ++num_loads == 1 ? make_failed_future<int>(9) : make_successful_future<int>(3);
+  }};
+
+  assert_fail_eq(memo.get(), 9);
+  assert_successful_result_eq(memo.get(), 3);
+}
+
+TEST(async_memo, invalidation_from_different_threads_in_turn) {
+  int source_value = 1;
+  async_memo<int> memo{[&] { return make_successful_future<int>(int{source_value}); }};
+
+  // Each thread starts from scratch, so per-thread invalidation numbers would repeat
+  for (int i = 0; i < 2; ++i) {
+    assert_successful_result_eq(memo.get(), int{source_value});
+    ++source_value;
+
+    std::thread{[&memo] { memo.invalidate(); }}.join();
+    ASSERT_FALSE(memo.has_value());
+  }
+
+  assert_successful_result_eq(memo.get(), 3);
+}
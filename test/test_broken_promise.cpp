@@ -0,0 +1,107 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+/// Built separately (`make broken_promise`) since MINICOROS_BROKEN_PROMISE_ERROR has to be set for every
+/// translation unit that uses minicoros.
+
+#include "testing.h"
+#include <minicoros/operations.h>
+#include <minicoros/testing.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+using namespace testing;
+using namespace mc;
+
+TEST(broken_promise, dropped_promise_fails_the_chain) {
+  bool called = false;
+  int error = 0;
+
+  future<int>([] (promise<int>) {}) // Drops the promise
+    .then([&] (int) { called = true; })
+    .fail([&] (int err) {
+      error = err;
+      return failure(std::move(err));
+    })
+    .ignore_result();
+
+  ASSERT_FALSE(called);
+  ASSERT_EQ(error, MINICOROS_BROKEN_PROMISE_ERROR);
+}
+
+TEST(broken_promise, dropped_promise_fails_when_it_is_dropped) {
+  auto captured_promise = std::make_unique<promise<void>>();
+  int error = 0;
+
+  future<void>([&] (promise<void> p) { *captured_promise = std::move(p); })
+    .fail([&] (int err) {
+      error = err;
+      return failure(std::move(err));
+    })
+    .ignore_result();
+
+  ASSERT_EQ(error, 0);
+  captured_promise = nullptr;
+  ASSERT_EQ(error, MINICOROS_BROKEN_PROMISE_ERROR);
+}
+
+TEST(broken_promise, dropped_promise_without_stages_reaches_the_sink) {
+  int error = 0;
+
+  future<int>([] (promise<int>) {})
+    .done([&] (concrete_result<int> result) { error = result.get_failure()->error; });
+
+  ASSERT_EQ(error, MINICOROS_BROKEN_PROMISE_ERROR);
+}
+
+TEST(broken_promise, combinator_state_is_released) {
+  auto payload = std::make_shared<int>(1);
+  std::weak_ptr<int> weak_payload = payload;
+  int error = 0;
+
+  std::vector<future<int>> v;
+  v.push_back(make_successful_future<int>(1));
+  v.push_back(future<int>([payload = std::move(payload)] (promise<int>) {}));
+
+  when_all(std::move(v))
+    .fail([&] (int err) {
+      error = err;
+      return failure(std::move(err));
+    })
+    .ignore_result();
+
+  ASSERT_EQ(error, MINICOROS_BROKEN_PROMISE_ERROR);
+  ASSERT_TRUE(weak_payload.expired());
+}
+
+TEST(broken_promise, invoked_promises_arent_reported) {
+  promise<int> p;
+  int num_calls = 0;
+
+  future<int>([&] (promise<int> inner) { p = std::move(inner); })
+    .done([&] (concrete_result<int> result) {
+      ++num_calls;
+      ASSERT_TRUE(result.success());
+    });
+
+  p(123);
+  p = {};
+  ASSERT_EQ(num_calls, 1);
+}
+
+TEST(broken_promise, dropping_a_copy_of_a_promise_isnt_reported) {
+  std::function<void()> stash;
+  std::vector<int> values;
+
+  future<int>([&] (promise<int> p) { stash = [p] () mutable { p(7); }; }) // Drops the original
+    .then([&] (int value) { values.push_back(value); })
+    .fail([&] (int err) {
+      values.push_back(err);
+      return failure(std::move(err));
+    })
+    .ignore_result();
+
+  ASSERT_EQ(values.size(), 0);
+  stash();
+  ASSERT_EQ(values.size(), 1);
+  ASSERT_EQ(values[0], 7);
+}
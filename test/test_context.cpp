@@ -0,0 +1,356 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#include "testing.h"
+#include <minicoros/context.h>
+#include <minicoros/operations.h>
+#include <minicoros/testing.h>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace testing;
+using namespace mc;
+
+TEST(context, chains_capture_the_current_context) {
+  auto ctx = make_context(444);
+  context* seen = nullptr;
+
+  future<void> fut = [&] {
+    context_scope scope{ctx};
+    return make_successful_future<int>(123);
+  }()
+  .then([&] (int) { seen = current_context(); });
+
+  ASSERT_EQ(current_context(), nullptr);
+  std::move(fut).ignore_result();
+  ASSERT_EQ(seen, ctx.get());
+  ASSERT_EQ(current_context(), nullptr);
+}
+
+TEST(context, futures_created_in_handlers_inherit_the_context) {
+  auto ctx = make_context(444);
+  ctx->set_trace_id(5);
+  promise<int> p;
+  uint64_t trace_id = 0;
+
+  {
+    context_scope scope{ctx};
+
+    make_successful_future<int>(1)
+      .then([&] (int) -> result<int> {
+        return future<int>([&] (promise<int> inner) { p = std::move(inner); });
+      })
+      .then([&] (int) -> result<void> {
+        std::vector<future<int>> v;
+        v.push_back(make_successful_future<int>(2));
+
+        return when_all(std::move(v)).then([&] (std::vector<int>) {
+          trace_id = current_context()->trace_id();
+        });
+      })
+      .ignore_result();
+  }
+
+  ASSERT_EQ(current_context(), nullptr);
+  p(123); // Resolved outside of the scope
+  ASSERT_EQ(trace_id, 5);
+}
+
+TEST(context, links_borrow_the_context_of_their_chain) {
+  auto ctx = make_context(444);
+  ctx->set_trace_id(7);
+  promise<int> p;
+  uint64_t trace_id = 0;
+
+  {
+    context_scope scope{ctx};
+    future<int> fut = future<int>([&] (promise<int>&& inner) { p = std::move(inner); });
+
+    for (int i = 0; i < 10; ++i)
+      fut = std::move(fut).then([] (int value) -> result<int> { return value + 1; });
+
+    ASSERT_EQ(ctx.use_count(), 2); // Only the chain holds a reference, not each of its links
+
+    std::move(fut)
+      .then([&] (int) { trace_id = current_context()->trace_id(); })
+      .ignore_result();
+  }
+
+  // The evaluated chain keeps the context alive until it has resolved
+  std::weak_ptr<context> weak_ctx = ctx;
+  ctx.reset();
+  ASSERT_FALSE(weak_ctx.expired());
+
+  p(1);
+  ASSERT_EQ(trace_id, 7);
+
+  p = {};
+  ASSERT_TRUE(weak_ctx.expired());
+}
+
+TEST(context, returned_futures_share_the_state_of_their_chain) {
+  auto allocations_of_chain = [] {
+    alloc_counter allocs;
+
+    make_successful_future<int>(1)
+      .then([] (int value) -> result<int> {
+        return make_successful_future<int>(value + 1).then([] (int value) -> result<int> { return value + 1; });
+      })
+      .then([] (int value) -> result<int> { return make_successful_future<int>(value + 1); })
+      .ignore_result();
+
+    return allocs.total_allocation_count();
+  };
+
+  int without_context = allocations_of_chain();
+
+  auto ctx = make_context(444);
+  context_scope scope{ctx};
+  ASSERT_EQ(allocations_of_chain(), without_context + 2); // Only the outermost chain creates a state, and a sink that owns it
+}
+
+TEST(context, cancelled_context_skips_then_handlers) {
+  auto ctx = make_context(444);
+  promise<int> p;
+  bool called = false;
+  int error = 0;
+
+  {
+    context_scope scope{ctx};
+
+    future<int>([&] (promise<int> inner) { p = std::move(inner); })
+      .then([&] (int) { called = true; })
+      .fail([&] (int err) {
+        error = err;
+        return failure(std::move(err));
+      })
+      .ignore_result();
+  }
+
+  ctx->cancel();
+  p(123);
+
+  ASSERT_FALSE(called);
+  ASSERT_EQ(error, 444);
+}
+
+TEST(context, expired_deadline_fails_the_chain) {
+  auto ctx = make_context(445);
+  ctx->set_deadline(context::clock::now() - std::chrono::milliseconds(1));
+
+  context_scope scope{ctx};
+  assert_fail_eq(make_successful_future<int>(1).then([] (int value) -> result<int> { return value; }), 445);
+}
+
+TEST(context, chains_without_context_are_unaffected) {
+  auto ctx = make_context(444);
+  ctx->cancel();
+
+  future<int> fut = make_successful_future<int>(123);
+
+  context_scope scope{ctx};
+  assert_successful_result_eq(std::move(fut).then([] (int value) -> result<int> { return value; }), 123);
+}
+
+TEST(memory_quota, chains_are_charged_until_they_have_finished) {
+  auto ctx = make_context(444);
+  ctx->set_memory_quota(1024 * 1024, 446);
+  promise<int> p;
+  size_t used_while_pending = 0;
+
+  {
+    context_scope scope{ctx};
+
+    future<int>([&] (promise<int> inner) { p = std::move(inner); })
+      .then([] (int value) -> result<int> { return value + 1; })
+      .then([] (int) {})
+      .ignore_result();
+
+    used_while_pending = ctx->memory_used();
+  }
+
+  ASSERT_TRUE((used_while_pending > 0));
+  p(123);
+  ASSERT_EQ(ctx->memory_used(), 0);
+  ASSERT_FALSE(ctx->expired());
+}
+
+TEST(memory_quota, allocator_overrun_fails_the_rest_of_the_chain) {
+  auto ctx = make_context(444);
+  ctx->set_memory_quota(16 * 1024, 446);
+  bool called = false;
+
+  context_scope scope{ctx};
+
+  future<void> fut = make_successful_future<int>(1)
+    .then([] (int) {
+      std::vector<char, quota_allocator<char>> buffer;
+      buffer.resize(64 * 1024);
+    })
+    .then([&] { called = true; });
+
+  assert_fail_eq(std::move(fut), 446);
+  ASSERT_FALSE(called);
+  ASSERT_TRUE(ctx->over_quota());
+}
+
+TEST(memory_quota, oversized_when_all_fails_without_starting_its_futures) {
+  auto ctx = make_context(444);
+  ctx->set_memory_quota(64 * 1024, 446);
+  int num_started = 0;
+
+  context_scope scope{ctx};
+  std::vector<future<int>> futures;
+
+  for (int i = 0; i < 100000; ++i) {
+    futures.push_back(future<int>([&num_started] (promise<int>&& p) {
+      ++num_started;
+      p({1});
+    }));
+  }
+
+  assert_fail_eq(when_all(std::move(futures)), 446);
+  ASSERT_EQ(num_started, 0);
+}
+
+TEST(memory_quota, heterogeneous_when_any_is_charged) {
+  auto ctx = make_context(444);
+  ctx->set_memory_quota(16, 446);
+
+  context_scope scope{ctx};
+  int num_started = 0;
+
+  auto first = future<int>([&num_started] (promise<int>&& p) {
+    ++num_started;
+    p({1});
+  });
+
+  auto second = future<std::string>([&num_started] (promise<std::string>&& p) {
+    ++num_started;
+    p(std::string{"2"});
+  });
+
+  assert_fail_eq(when_any(std::move(first), std::move(second)), 446);
+  ASSERT_EQ(num_started, 0);
+}
+
+TEST(memory_quota, when_all_within_the_quota_succeeds) {
+  auto ctx = make_context(444);
+  ctx->set_memory_quota(1024 * 1024, 446);
+
+  context_scope scope{ctx};
+  std::vector<future<int>> futures;
+  futures.push_back(make_successful_future<int>(1));
+  futures.push_back(make_successful_future<int>(2));
+
+  assert_successful_result_eq(when_all(std::move(futures)).then([] (std::vector<int> values) -> result<int> {
+    return values[0] + values[1];
+  }), 3);
+  ASSERT_EQ(ctx->memory_used(), 0);
+}
+
+namespace {
+
+async_local<std::string> request_name;
+
+class work_queue {
+public:
+  void enqueue_work(std::function<void()> item) {
+    work_items_.push_back(std::move(item));
+  }
+
+  void execute() {
+    std::vector<std::function<void()>> items = std::move(work_items_);
+
+    for (auto& item : items)
+      item();
+  }
+
+private:
+  std::vector<std::function<void()>> work_items_;
+};
+
+} // namespace
+
+TEST(async_local, is_empty_without_context) {
+  ASSERT_EQ(request_name.get(), nullptr);
+}
+
+TEST(async_local, follows_the_chain_across_executor_hops) {
+  work_queue queue;
+  auto executor = [&queue] (auto&& work) { queue.enqueue_work(std::move(work)); };
+  std::vector<std::string> seen;
+
+  for (const char* name : {"first", "second"}) {
+    auto ctx = make_context(444);
+    context_scope scope{ctx};
+
+    make_successful_future<void>()
+      .then([name] { request_name.set(name); })
+      .enqueue(executor)
+      .then([&] { seen.push_back(*request_name.get()); })
+      .ignore_result();
+  }
+
+  ASSERT_EQ(request_name.get(), nullptr);
+  ASSERT_EQ(seen.size(), 0);
+
+  queue.execute();
+  ASSERT_EQ(seen.size(), 2);
+  ASSERT_EQ(seen[0], "first");
+  ASSERT_EQ(seen[1], "second");
+  ASSERT_EQ(request_name.get(), nullptr);
+}
+
+TEST(async_local, isnt_shared_between_branches) {
+  auto ctx = make_context(444);
+  context_scope scope{ctx};
+  request_name.set("parent");
+
+  std::vector<future<std::string>> branches;
+
+  for (const char* name : {"first", "second"}) {
+    branches.push_back(make_successful_future<void>().then([name] () -> result<std::string> {
+      std::string inherited = *request_name.get();
+      request_name.set(name);
+      return inherited + ">" + *request_name.get();
+    }));
+  }
+
+  assert_successful_result_eq(when_all(std::move(branches)).then([] (std::vector<std::string> values) -> result<std::string> {
+    return values[0] + "," + values[1] + "," + *request_name.get();
+  }), std::string{"parent>first,parent>second,parent"});
+}
+
+TEST(async_local, is_set_by_returned_futures_for_the_rest_of_the_chain) {
+  auto ctx = make_context(444);
+  context_scope scope{ctx};
+  request_name.set("scope");
+
+  assert_successful_result_eq(make_successful_future<void>()
+    .then([] () -> result<void> {
+      return make_successful_future<void>().then([] { request_name.set("returned"); });
+    })
+    .then([] () -> result<std::string> { return *request_name.get(); }), std::string{"returned"});
+
+  ASSERT_EQ(*request_name.get(), "scope");
+}
+
+TEST(async_local, values_outlive_being_overwritten) {
+  auto ctx = make_context(444);
+  context_scope scope{ctx};
+
+  request_name.set("first");
+  std::shared_ptr<const std::string> first = request_name.get();
+  request_name.set("second");
+
+  ASSERT_EQ(*first, "first");
+  ASSERT_EQ(*request_name.get(), "second");
+}
+
+TEST(async_local, cant_be_set_without_context) {
+  ASSERT_FALSE(request_name.set("name"));
+  ASSERT_EQ(request_name.get(), nullptr);
+}
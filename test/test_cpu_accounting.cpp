@@ -0,0 +1,100 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+/// Built separately (`make cpu_accounting`) since MINICOROS_ENABLE_CPU_ACCOUNTING has to be set for every
+/// translation unit that uses minicoros.
+
+#include "testing.h"
+#include <minicoros/context.h>
+#include <minicoros/operations.h>
+#include <minicoros/testing.h>
+#include <chrono>
+#include <cstring>
+
+using namespace testing;
+using namespace mc;
+
+namespace {
+
+volatile int sink;
+
+/// Spins for 2ms of thread CPU time
+void burn_cpu() {
+  int64_t end = detail::thread_cpu_time_ns() + 2000000;
+
+  while (detail::thread_cpu_time_ns() < end)
+    sink = sink + 1;
+}
+
+} // namespace
+
+TEST(cpu_accounting, charges_stages_to_their_context) {
+  auto ctx = make_context(444);
+  promise<void> p;
+
+  {
+    context_scope scope{ctx};
+
+    future<void>([&] (promise<void> inner) { p = std::move(inner); })
+      .then([] { burn_cpu(); })
+      .then([] { burn_cpu(); })
+      .ignore_result();
+  }
+
+  ASSERT_TRUE((ctx->cpu_time() < std::chrono::milliseconds(1))); // Only setting up the chain
+  burn_cpu(); // Not charged, there's no current context
+
+  p({});
+  ASSERT_TRUE((ctx->cpu_time() >= std::chrono::milliseconds(3)));
+  ASSERT_TRUE((ctx->cpu_time() < std::chrono::milliseconds(6)));
+}
+
+TEST(cpu_accounting, cpu_time_is_available_in_the_last_stage) {
+  auto ctx = make_context(444);
+  std::chrono::nanoseconds cpu_time{0};
+
+  {
+    context_scope scope{ctx};
+
+    make_successful_future<void>()
+      .then([] { burn_cpu(); })
+      .then([&] { cpu_time = current_context()->cpu_time(); })
+      .ignore_result();
+  }
+
+  ASSERT_TRUE((cpu_time >= std::chrono::milliseconds(1)));
+}
+
+TEST(cpu_accounting, nested_contexts_are_charged_separately) {
+  auto outer = make_context(444);
+  auto inner = make_context(445);
+
+  context_scope scope{outer};
+  burn_cpu();
+
+  {
+    context_scope inner_scope{inner};
+    burn_cpu();
+    burn_cpu();
+  }
+
+  ASSERT_TRUE((inner->cpu_time() >= std::chrono::milliseconds(3)));
+  ASSERT_TRUE((outer->cpu_time() >= std::chrono::milliseconds(1)));
+  ASSERT_TRUE((outer->cpu_time() < std::chrono::milliseconds(3)));
+}
+
+TEST(cpu_accounting, aggregates_by_name) {
+  cpu_accounting::reset();
+
+  for (int i = 0; i < 2; ++i) {
+    auto ctx = make_context(444);
+    ctx->set_name("checkout");
+    context_scope scope{ctx};
+
+    make_successful_future<void>().then([] { burn_cpu(); }).ignore_result();
+  }
+
+  auto entries = cpu_accounting::snapshot();
+  ASSERT_EQ(entries.size(), 1);
+  ASSERT_EQ(std::strcmp(entries[0].name, "checkout"), 0);
+  ASSERT_EQ(entries[0].num_contexts, 2);
+  ASSERT_TRUE((entries[0].cpu_time >= std::chrono::milliseconds(3)));
+}
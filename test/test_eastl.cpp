@@ -0,0 +1,99 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+/// Built by the `test_eastl` target, which defines `MINICOROS_USE_EASTL`.
+
+#include "testing.h"
+#include <minicoros/operations.h>
+#include <minicoros/testing.h>
+#include <eastl/string.h>
+#include <eastl/vector.h>
+
+using namespace testing;
+using namespace mc;
+
+// EASTL requires the application to provide these
+void* operator new[](size_t size, const char*, int, unsigned, const char*, int) {
+  return ::operator new(size);
+}
+
+void* operator new[](size_t size, size_t alignment, size_t, const char*, int, unsigned, const char*, int) {
+  return ::operator new(size, std::align_val_t{alignment});
+}
+
+TEST(eastl, chaining_works) {
+  auto count = eastl::make_shared<int>(0);
+
+  future<int>([](promise<int> p) {
+    p(123);
+  })
+  .then([count](int value) -> result<eastl::string> {
+    ++*count;
+    ASSERT_EQ(value, 123);
+    return eastl::string{"hullo"};
+  })
+  .then([count](eastl::string value) {
+    ++*count;
+    ASSERT_TRUE(value == "hullo");
+  })
+  .done([](auto) {});
+
+  ASSERT_EQ(*count, 2);
+}
+
+TEST(eastl, when_all_resolves_values_in_order) {
+  eastl::vector<future<int>> v;
+  promise<int> p1, p2;
+  bool called = false;
+
+  v.push_back(future<int>([&](promise<int> p) {p1 = eastl::move(p); }));
+  v.push_back(future<int>([&](promise<int> p) {p2 = eastl::move(p); }));
+
+  when_all(eastl::move(v))
+    .then([&](eastl::vector<int> result) {
+      ASSERT_EQ(result.size(), 2u);
+      ASSERT_EQ(result[0], 123);
+      ASSERT_EQ(result[1], 444);
+      called = true;
+    })
+    .ignore_result();
+
+  p2(444);
+  ASSERT_FALSE(called);
+  p1(123);
+  ASSERT_TRUE(called);
+}
+
+TEST(eastl, when_all_overflows_fixed_storage) {
+  eastl::vector<future<int>> v;
+
+  for (int i = 0; i < MINICOROS_EASTL_FIXED_VECTOR_SIZE * 2 + 1; ++i)
+    v.push_back(make_successful_future<int>(int{i}));
+
+  bool called = false;
+
+  when_all(eastl::move(v))
+    .then([&](eastl::vector<int> result) {
+      ASSERT_EQ(result.size(), size_t{MINICOROS_EASTL_FIXED_VECTOR_SIZE * 2 + 1});
+      ASSERT_EQ(result.back(), MINICOROS_EASTL_FIXED_VECTOR_SIZE * 2);
+      called = true;
+    })
+    .ignore_result();
+
+  ASSERT_TRUE(called);
+}
+
+TEST(eastl, small_fan_outs_are_stored_inline) {
+  eastl::vector<future<void>> v;
+  v.push_back(make_successful_future<void>());
+  v.push_back(make_successful_future<void>());
+
+  auto chains = detail::unwrap_chains(eastl::move(v));
+  ASSERT_FALSE(chains.has_overflowed());
+
+  for (auto& chain : chains)
+    eastl::move(chain).evaluate_into([](auto) {});
+}
+
+TEST(eastl, andand_and_oror_work) {
+  assert_successful_result_eq(make_successful_future<int>(1) && make_successful_future<bool>(true), {1, true});
+  assert_fail_eq(make_failed_future<int>(555) || make_successful_future<int>(123), 555);
+}
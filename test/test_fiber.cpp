@@ -0,0 +1,147 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#include "testing.h"
+#include <minicoros/fiber.h>
+#include <minicoros/testing.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+using namespace mc;
+
+TEST(fiber, runs_until_finished) {
+  bool called = false;
+
+  ASSERT_EQ(fiber::current(), nullptr);
+  fiber::start([&] { called = fiber::current() != nullptr; });
+  ASSERT_TRUE(called);
+  ASSERT_EQ(fiber::current(), nullptr);
+}
+
+TEST(fiber, await_of_resolved_future_doesnt_suspend) {
+  int value = 0;
+
+  fiber::start([&] {
+    value = *await(make_successful_future<int>(123)).get_value();
+  });
+
+  ASSERT_EQ(value, 123);
+}
+
+TEST(fiber, await_suspends_until_the_promise_is_resolved) {
+  promise<std::string> p;
+  std::vector<std::string> events;
+
+  fiber::start([&] {
+    events.push_back("start");
+    concrete_result<std::string> result = await(future<std::string>([&] (promise<std::string> inner) { p = std::move(inner); }));
+    events.push_back(*result.get_value());
+  });
+
+  events.push_back("suspended");
+  p(std::string{"resumed"});
+
+  ASSERT_EQ(events.size(), 3);
+  ASSERT_EQ(events[0], "start");
+  ASSERT_EQ(events[1], "suspended");
+  ASSERT_EQ(events[2], "resumed");
+}
+
+TEST(fiber, await_returns_failures) {
+  int error = 0;
+
+  fiber::start([&] {
+    error = await(make_failed_future<void>(444)).get_failure()->error;
+  });
+
+  ASSERT_EQ(error, 444);
+}
+
+TEST(fiber, many_parked_fibers_reuse_stacks) {
+  std::vector<promise<int>> promises(1000);
+  int sum = 0;
+
+  for (auto& p : promises) {
+    fiber::start([&] {
+      sum += *await(future<int>([&] (promise<int> inner) { p = std::move(inner); })).get_value();
+    });
+  }
+
+  for (auto& p : promises)
+    p(1);
+
+  ASSERT_EQ(sum, 1000);
+  ASSERT_EQ(detail::fiber_stack_pool::local().num_free_stacks(), MINICOROS_FIBER_STACK_POOL_SIZE);
+}
+
+TEST(fiber, run_in_fiber_resolves_with_the_result_of_the_body) {
+  promise<int> p;
+
+  future<int> fut = run_in_fiber<int>([&] () -> concrete_result<int> {
+    int value = *await(future<int>([&] (promise<int> inner) { p = std::move(inner); })).get_value();
+    return value + 1;
+  }, 444);
+
+  int value = 0;
+  std::move(fut).then([&] (int result) { value = result; }).ignore_result();
+
+  p(122);
+  ASSERT_EQ(value, 123);
+}
+
+TEST(fiber, stacks_that_cant_be_mapped_are_reported) {
+  detail::fiber_stack stack = detail::fiber_stack_pool::map(SIZE_MAX / 2);
+  ASSERT_EQ(stack.base, nullptr);
+
+  stack = detail::fiber_stack_pool::map(SIZE_MAX);
+  ASSERT_EQ(stack.base, nullptr);
+}
+
+TEST(fiber, start_reports_whether_the_fiber_started) {
+  bool called = false;
+
+  ASSERT_TRUE(fiber::start([&] { called = true; }));
+  ASSERT_TRUE(called);
+}
+
+TEST(fiber, await_can_be_resolved_from_another_thread) {
+  constexpr int num_fibers = 1000;
+  std::atomic<int> num_finished{0};
+  std::atomic<int> num_resolved{0};
+  std::atomic<promise<int>*> pending{nullptr};
+  std::atomic<bool> done{false};
+
+  // Resolves promises as soon as they're handed over, racing with the fiber that's about to suspend
+  std::thread resolver{[&] {
+    while (!done.load()) {
+      if (promise<int>* p = pending.exchange(nullptr)) {
+        (*p)(1);
+        num_resolved.fetch_add(1);
+      }
+
+      std::this_thread::yield();
+    }
+  }};
+
+  for (int i = 0; i < num_fibers; ++i) {
+    promise<int> p;
+
+    fiber::start([&] {
+      concrete_result<int> result = await(future<int>([&] (promise<int> inner) {
+        p = std::move(inner);
+        pending.store(&p);
+      }));
+
+      num_finished.fetch_add(*result.get_value());
+    });
+
+    while (num_resolved.load() != i + 1)
+      std::this_thread::yield();
+  }
+
+  done.store(true);
+  resolver.join();
+  ASSERT_EQ(num_finished.load(), num_fibers);
+}
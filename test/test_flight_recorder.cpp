@@ -0,0 +1,77 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+/// Built separately (`make flight_recorder`), with the recorder enabled explicitly, so that the tests also run where
+/// it isn't on by default.
+
+#include "testing.h"
+#include <minicoros/operations.h>
+#include <minicoros/testing.h>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace testing;
+using namespace mc;
+
+namespace {
+
+std::string dump_to_string() {
+  int fds[2];
+  pipe(fds);
+  flight_recorder::dump(fds[1]);
+  close(fds[1]);
+
+  std::string output;
+  char buffer[4096];
+  ssize_t size;
+
+  while ((size = read(fds[0], buffer, sizeof(buffer))) > 0)
+    output.append(buffer, static_cast<size_t>(size));
+
+  close(fds[0]);
+  return output;
+}
+
+size_t count(const std::string& haystack, const std::string& needle) {
+  size_t num = 0;
+
+  for (size_t pos = haystack.find(needle); pos != std::string::npos; pos = haystack.find(needle, pos + 1))
+    ++num;
+
+  return num;
+}
+
+} // namespace
+
+TEST(flight_recorder, records_stages_and_failures) {
+  auto ctx = make_context(444);
+  ctx->set_trace_id(987654321);
+  context_scope scope{ctx};
+
+  make_successful_future<int>(1)
+    .then([] (int) -> result<void> { return failure(445); })
+    .then([] {})
+    .ignore_result();
+
+  std::string output = dump_to_string();
+  ASSERT_TRUE((count(output, "stage_entered") >= 2));
+  ASSERT_TRUE((count(output, "failure") >= 1));
+  ASSERT_TRUE((count(output, "trace=987654321") >= 3));
+}
+
+TEST(flight_recorder, records_combinator_joins) {
+  size_t joins_before = count(dump_to_string(), "combinator_joined");
+
+  std::vector<future<int>> v;
+  v.push_back(make_successful_future<int>(1));
+  v.push_back(make_successful_future<int>(2));
+  when_all(std::move(v)).ignore_result();
+
+  ASSERT_EQ(count(dump_to_string(), "combinator_joined"), joins_before + 1);
+}
+
+TEST(flight_recorder, keeps_the_last_events) {
+  for (int i = 0; i < MINICOROS_FLIGHT_RECORDER_SIZE; ++i)
+    make_successful_future<int>(1).then([] (int) {}).ignore_result();
+
+  ASSERT_EQ(count(dump_to_string(), "\n"), MINICOROS_FLIGHT_RECORDER_SIZE);
+}
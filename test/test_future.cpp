@@ -3,6 +3,7 @@
 #include "testing.h"
 #include <minicoros/future.h>
 #include <minicoros/testing.h>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -625,6 +626,65 @@ TEST(future, partial_application_can_take_subsets) {
   ASSERT_EQ(*call_count, 4);
 }
 
+TEST(future, then_takes_auto_parameters) {
+  auto call_count = std::make_shared<int>();
+
+  mc::make_successful_future<int>(123)
+    .then([call_count](auto value) -> mc::result<std::string> {
+      ++*call_count;
+      ASSERT_EQ(value, 123);
+      return std::to_string(value);
+    })
+    .then([call_count](auto&& value) {
+      ++*call_count;
+      ASSERT_EQ(value, "123");
+    })
+    .ignore_result();
+
+  ASSERT_EQ(*call_count, 2);
+}
+
+TEST(future, then_takes_auto_parameters_for_tuples) {
+  auto call_count = std::make_shared<int>();
+
+  (mc::make_successful_future<int>(123) && mc::make_successful_future<std::string>("hello"))
+    .then([call_count](auto v1, auto&& v2) {
+      ++*call_count;
+      ASSERT_EQ(v1, 123);
+      ASSERT_EQ(v2, "hello");
+    })
+    .ignore_result();
+
+  (mc::make_successful_future<int>(123) && mc::make_successful_future<std::string>("hello"))
+    .then([call_count](auto v1) {
+      ++*call_count;
+      ASSERT_EQ(v1, 123);
+    })
+    .ignore_result();
+
+  (mc::make_successful_future<int>(123) && mc::make_successful_future<std::string>("hello"))
+    .then([call_count](auto&&... values) {
+      ++*call_count;
+      ASSERT_EQ(sizeof...(values), 2);
+    })
+    .ignore_result();
+
+  ASSERT_EQ(*call_count, 3);
+}
+
+TEST(future, then_takes_lvalue_callbacks) {
+  auto call_count = std::make_shared<int>();
+  auto callback = [call_count](int value) {
+    ++*call_count;
+    ASSERT_EQ(value, 123);
+  };
+
+  mc::make_successful_future<int>(123).then(callback).ignore_result();
+  mc::make_successful_future<int>(123).then(callback).ignore_result();
+
+  ASSERT_EQ(*call_count, 2);
+}
+
 TEST(future, can_return_composed_futures) {
   auto call_count = std::make_shared<int>();
 
@@ -773,6 +833,56 @@ TEST(future, captured_promise_does_not_evaluate_rest_of_chain) {
   ASSERT_FALSE(*called);
 }
 
+TEST(future, handler_captures_are_released_after_the_handler_has_run) {
+  auto payload = std::make_shared<std::string>("request payload");
+  std::weak_ptr<std::string> weak_payload = payload;
+  mc::promise<int> backend_promise;
+  mc::promise<int> leaf_promise;
+  int result = 0;
+
+  mc::future<int>([&] (mc::promise<int> p) {leaf_promise = std::move(p); })
+    .then([payload = std::move(payload)] (int value) -> mc::result<int> {
+      return value + static_cast<int>(payload->size());
+    })
+    .then([&] (int value) -> mc::result<int> {
+      return mc::future<int>([&, value] (mc::promise<int> p) {
+        backend_promise = [value, p = std::move(p)] (mc::concrete_result<int>&& backend_result) mutable {
+          p(*backend_result.get_value() + value);
+        };
+      });
+    })
+    .then([&] (int value) {result = value; })
+    .ignore_result();
+
+  ASSERT_FALSE(weak_payload.expired());
+
+  leaf_promise(1); // The first handler runs and the chain waits on the backend, which keeps `leaf_promise` alive
+  ASSERT_TRUE(weak_payload.expired());
+
+  backend_promise(100);
+  ASSERT_EQ(result, 116);
+}
+
+TEST(future, fail_handler_captures_are_released_after_the_handler_has_run) {
+  auto payload = std::make_shared<int>(1);
+  std::weak_ptr<int> weak_payload = payload;
+  mc::promise<void> leaf_promise;
+  mc::promise<void> backend_promise;
+
+  mc::future<void>([&] (mc::promise<void> p) {leaf_promise = std::move(p); })
+    .fail([payload = std::move(payload)] (int error) {
+      return mc::failure(error + *payload);
+    })
+    .then([&] () -> mc::result<void> {
+      return mc::future<void>([&] (mc::promise<void> p) {backend_promise = std::move(p); });
+    })
+    .ignore_result();
+
+  leaf_promise({});
+  ASSERT_TRUE(weak_payload.expired());
+  backend_promise({});
+}
+
 TEST(future, freeze_makes_future_not_evaluate) {
   bool called = false;
 
@@ -787,6 +897,31 @@ TEST(future, freeze_makes_future_not_evaluate) {
   ASSERT_FALSE(called);
 }
 
+TEST(future, assigning_over_an_unevaluated_future_evaluates_it) {
+  bool called = false;
+
+  mc::future<void> fut([&called] (auto&& p) {
+    called = true;
+    p({});
+  });
+
+  fut = mc::make_successful_future<void>();
+  ASSERT_TRUE(called);
+}
+
+TEST(future, copied_promise_resolves_the_chain) {
+  std::function<void()> stash;
+  int got = -1;
+
+  mc::future<int>([&] (mc::promise<int> p) { stash = [p] () mutable { p(7); }; })
+    .then([&] (int value) { got = value; })
+    .ignore_result();
+
+  ASSERT_EQ(got, -1);
+  stash();
+  ASSERT_EQ(got, 7);
+}
+
 mc::future<int> foo1() {
   return mc::make_successful_future<int>(1)
     .then([] (int val) -> mc::result<int> {return val + 1; });
@@ -0,0 +1,38 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#include "testing.h"
+#include "instantiated_futures.h"
+#include <minicoros/testing.h>
+#include <string>
+#include <tuple>
+
+// The futures are only declared here; instantiated_futures.cpp instantiates them
+
+using namespace testing;
+
+TEST(instantiation, declared_futures_can_be_chained) {
+  mc::future<std::string> fut = mc::make_successful_future<int>(123)
+    .then([] (int value) -> mc::result<std::string> {
+      return std::to_string(value);
+    });
+
+  mc::assert_successful_result_eq(std::move(fut), std::string{"123"});
+}
+
+TEST(instantiation, declared_void_futures_propagate_failures) {
+  mc::future<void> fut = mc::make_successful_future<void>()
+    .then([] () -> mc::result<void> {
+      return mc::failure(444);
+    });
+
+  mc::assert_fail_eq(std::move(fut), 444);
+}
+
+TEST(instantiation, declared_futures_can_be_moved_and_composed) {
+  mc::future<int> fut1 = mc::make_successful_future<int>(1);
+  mc::future<int> fut2 = mc::make_successful_future<int>(2);
+  fut1 = std::move(fut2);
+
+  mc::future<std::tuple<int, std::string>> composed = std::move(fut1) && mc::make_successful_future<std::string>("hello");
+  mc::assert_successful_result_eq(std::move(composed), {2, std::string{"hello"}});
+}
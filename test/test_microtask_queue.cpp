@@ -0,0 +1,126 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#include "testing.h"
+#include <minicoros/future.h>
+#include <minicoros/microtask_queue.h>
+#include <minicoros/testing.h>
+#include <vector>
+
+using namespace testing;
+using namespace mc;
+
+TEST(microtask_queue, continuations_run_at_the_end_of_the_turn) {
+  microtask_queue microtasks;
+  int value = 0;
+
+  make_successful_future<int>(1)
+    .enqueue(microtasks.executor())
+    .then([&] (int result) { value = result; })
+    .ignore_result();
+
+  ASSERT_EQ(value, 0);
+  ASSERT_EQ(microtasks.num_pending_tasks(), 1);
+
+  microtasks.drain();
+  ASSERT_EQ(value, 1);
+  ASSERT_EQ(microtasks.num_turns(), 1);
+}
+
+TEST(microtask_queue, tasks_enqueued_while_draining_run_in_the_same_turn) {
+  microtask_queue microtasks;
+  int num_hops = 0;
+
+  future<void> fut = make_successful_future<void>();
+
+  for (int i = 0; i < 1000; ++i)
+    fut = std::move(fut).enqueue(microtasks.executor()).then([&] { ++num_hops; });
+
+  std::move(fut).ignore_result();
+  microtasks.drain();
+
+  ASSERT_EQ(num_hops, 1000);
+  ASSERT_EQ(microtasks.num_pending_tasks(), 0);
+}
+
+TEST(microtask_queue, turn_hooks_flush_batches) {
+  microtask_queue microtasks;
+  std::vector<int> batch;
+  std::vector<size_t> flushed_batch_sizes;
+
+  microtasks.add_turn_hook([&] {
+    if (!batch.empty())
+      flushed_batch_sizes.push_back(batch.size());
+
+    batch.clear();
+  });
+
+  for (int i = 0; i < 3; ++i) {
+    make_successful_future<int>(int{i})
+      .enqueue(microtasks.executor())
+      .then([&] (int value) { batch.push_back(value); })
+      .ignore_result();
+  }
+
+  microtasks.drain();
+  ASSERT_EQ(flushed_batch_sizes.size(), 1);
+  ASSERT_EQ(flushed_batch_sizes[0], 3);
+}
+
+TEST(microtask_queue, work_enqueued_by_hooks_is_drained) {
+  microtask_queue microtasks;
+  bool flushed = false;
+  bool continued = false;
+
+  auto id = microtasks.add_turn_hook([&] {
+    if (flushed)
+      return;
+
+    flushed = true;
+    make_successful_future<void>()
+      .enqueue(microtasks.executor())
+      .then([&] { continued = true; })
+      .ignore_result();
+  });
+
+  microtasks.drain();
+  ASSERT_TRUE(continued);
+
+  microtasks.remove_turn_hook(id);
+  flushed = false;
+  microtasks.drain();
+  ASSERT_FALSE(flushed);
+}
+
+TEST(microtask_queue, hooks_can_remove_hooks_while_running) {
+  microtask_queue microtasks;
+  std::vector<int> ran;
+
+  auto first = microtasks.add_turn_hook([&] { ran.push_back(0); });
+  microtasks.add_turn_hook([&] {
+    ran.push_back(1);
+    microtasks.remove_turn_hook(first);
+  });
+  microtasks.add_turn_hook([&] { ran.push_back(2); });
+
+  microtasks.drain();
+  ASSERT_EQ(ran.size(), 3); // Removing an earlier hook doesn't skip the next one
+  ASSERT_EQ(ran[2], 2);
+
+  ran.clear();
+  microtasks.drain();
+  ASSERT_EQ(ran.size(), 2);
+  ASSERT_EQ(ran[0], 1);
+  ASSERT_EQ(ran[1], 2);
+}
+
+TEST(microtask_queue, threshold_drains_early) {
+  microtask_queue microtasks{2};
+  int num_run = 0;
+
+  microtasks.enqueue([&] { ++num_run; });
+  ASSERT_EQ(num_run, 0);
+
+  microtasks.enqueue([&] { ++num_run; });
+  ASSERT_EQ(num_run, 2);
+  ASSERT_EQ(microtasks.num_pending_tasks(), 0);
+}
@@ -0,0 +1,130 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+/// Built by the `modules` target, which compiles the `minicoros` module. Nothing here includes a minicoros header, so
+/// every name the tests use has to come from the module's export list.
+
+#include "testing.h"
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+import minicoros;
+
+using namespace testing;
+
+namespace {
+
+template<typename T>
+mc::concrete_result<T> evaluate(mc::future<T>&& fut) {
+  std::vector<mc::concrete_result<T>> results;
+  std::move(fut).chain().evaluate_into([&results] (mc::concrete_result<T>&& result) {
+    results.push_back(std::move(result));
+  });
+
+  ASSERT_EQ(results.size(), 1);
+  return std::move(results[0]);
+}
+
+} // namespace
+
+TEST(modules, futures_can_be_chained) {
+  mc::future<std::string> fut = mc::make_successful_future<int>(123)
+    .then([] (int value) -> mc::result<std::string> {
+      return std::to_string(value);
+    });
+
+  auto result = evaluate(std::move(fut));
+  ASSERT_TRUE(result.success());
+  ASSERT_EQ(*result.get_value(), "123");
+}
+
+TEST(modules, combinators_are_exported) {
+  std::vector<mc::future<int>> futures;
+  futures.push_back(mc::make_successful_future<int>(1));
+  futures.push_back(mc::make_failed_future<int>(444));
+
+  auto result = evaluate(mc::when_all(std::move(futures)) || mc::make_successful_future<std::vector<int>>({}));
+  ASSERT_FALSE(result.success());
+  ASSERT_EQ(result.get_failure()->error, 444);
+}
+
+TEST(modules, extensions_are_exported) {
+  mc::microtask_queue microtasks;
+  auto [p, fut] = mc::make_promise_future_pair<int>();
+  int value = 0;
+
+  std::move(fut)
+    .enqueue(microtasks.executor())
+    .then([&value] (int result) { value = result; })
+    .ignore_result();
+
+  p({5});
+  ASSERT_EQ(value, 0);
+
+  microtasks.drain();
+  ASSERT_EQ(value, 5);
+}
+
+TEST(modules, spawn_is_exported) {
+  auto [p, fut] = mc::make_promise_future_pair<int>();
+  int num_started = 0;
+
+  mc::future<int> spawned = mc::spawn(std::move(fut).then([&num_started] (int value) -> mc::result<int> {
+    ++num_started;
+    return value + 1;
+  }));
+
+  p({1});
+  ASSERT_EQ(num_started, 1);
+
+  auto result = evaluate(std::move(spawned));
+  ASSERT_TRUE(result.success());
+  ASSERT_EQ(*result.get_value(), 2);
+}
+
+TEST(modules, when_all_until_is_exported) {
+  auto [deadline_promise, deadline] = mc::make_promise_future_pair<void>();
+  auto [straggler_promise, straggler] = mc::make_promise_future_pair<int>();
+
+  std::vector<mc::future<int>> futures;
+  futures.push_back(mc::make_successful_future<int>(1));
+  futures.push_back(std::move(straggler));
+
+  std::vector<std::vector<std::optional<mc::concrete_result<int>>>> results;
+  mc::when_all_until(std::move(futures), std::move(deadline))
+    .then([&results] (std::vector<std::optional<mc::concrete_result<int>>> settled) {
+      results.push_back(std::move(settled));
+    })
+    .ignore_result();
+
+  deadline_promise({});
+  ASSERT_EQ(results.size(), 1);
+  ASSERT_EQ(results[0].size(), 2);
+  ASSERT_EQ(*results[0][0]->get_value(), 1);
+  ASSERT_FALSE(results[0][1].has_value());
+
+  straggler_promise({2});
+}
+
+TEST(modules, pool_is_exported) {
+  std::vector<int, mc::pool_allocator<int>> values{1, 2, 3};
+  mc::pooled_function<int(int)> add = [&values] (int value) { return values[2] + value; };
+
+  ASSERT_EQ(add(2), 5);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST(modules, fibers_are_exported) {
+  auto [p, fut] = mc::make_promise_future_pair<int>();
+  mc::future<int> awaited = std::move(fut);
+  int value = 0;
+
+  ASSERT_TRUE(mc::fiber::start([&value, &awaited] {
+    value = *mc::await(std::move(awaited)).get_value();
+  }));
+
+  ASSERT_EQ(value, 0);
+  p({7});
+  ASSERT_EQ(value, 7);
+}
+#endif
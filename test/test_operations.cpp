@@ -5,6 +5,7 @@
 #include <minicoros/testing.h>
 #include <memory>
 #include <string>
+#include <variant>
 #include <vector>
 
 using namespace testing;
@@ -137,7 +138,7 @@ TEST(operations_when_seq, vector_of_successful_futures_returns_successfully) {
 TEST(operations_when_seq, futures_are_evaluated_in_order) {
   std::vector<future<int>> v;
   promise<int> p1, p2;
-  bool called;
+  bool called = false;
 
   v.push_back(future<int>([&](promise<int> p) {p1 = std::move(p); }));
   v.push_back(future<int>([&](promise<int> p) {p2 = std::move(p); }));
@@ -181,3 +182,166 @@ TEST(operations_when_seq, takes_void) {
   v.push_back(make_successful_future<void>());
   assert_successful_result(when_seq(std::move(v)));
 }
+
+TEST(operations_spawn, starts_evaluation_immediately) {
+  promise<int> p1;
+  auto fut = spawn(future<int>([&](promise<int> p) {p1 = std::move(p); }));
+
+  ASSERT_TRUE(bool{p1});
+  fut.freeze();
+}
+
+TEST(operations_spawn, buffers_result_until_attached) {
+  auto num_invocations = std::make_shared<int>();
+
+  auto fut = spawn(make_successful_future<int>(123)
+    .then([num_invocations](int value) -> result<int> {
+      ++*num_invocations;
+      return value + 1;
+    }));
+
+  ASSERT_EQ(*num_invocations, 1);
+  assert_successful_result_eq(std::move(fut), 124);
+  ASSERT_EQ(*num_invocations, 1);
+}
+
+TEST(operations_spawn, delivers_result_when_attached_first) {
+  promise<int> p1;
+  bool called = false;
+
+  spawn(future<int>([&](promise<int> p) {p1 = std::move(p); }))
+    .then([&](int value) {
+      ASSERT_EQ(value, 444);
+      called = true;
+    })
+    .ignore_result();
+
+  ASSERT_FALSE(called);
+  p1(444);
+  ASSERT_TRUE(called);
+}
+
+TEST(operations_spawn, propagates_failures) {
+  assert_fail_eq(spawn(make_failed_future<int>(555)), 555);
+  assert_fail_eq(spawn(make_failed_future<void>(556)), 556);
+}
+
+TEST(operations_spawn, supports_void) {
+  auto fut = spawn(make_successful_future<void>());
+  assert_successful_result(std::move(fut));
+}
+
+TEST(operations_when_all_until, resolves_when_all_futures_finish_before_the_deadline) {
+  std::vector<future<int>> v;
+  v.push_back(make_successful_future<int>(123));
+  v.push_back(make_failed_future<int>(444));
+
+  promise<void> deadline;
+  bool called = false;
+
+  when_all_until(std::move(v), future<void>([&](promise<void> p) {deadline = std::move(p); }))
+    .then([&](std::vector<std::optional<concrete_result<int>>> results) {
+      ASSERT_EQ(results.size(), 2);
+      ASSERT_TRUE(results[0].has_value());
+      ASSERT_TRUE(results[0]->success());
+      ASSERT_EQ(*results[0]->get_value(), 123);
+      ASSERT_TRUE(results[1].has_value());
+      ASSERT_FALSE(results[1]->success());
+      ASSERT_EQ(results[1]->get_failure()->error, 444);
+      called = true;
+    })
+    .ignore_result();
+
+  ASSERT_TRUE(called);
+  deadline({}); // Check that it doesn't crash
+}
+
+TEST(operations_when_all_until, resolves_with_partial_results_at_the_deadline) {
+  std::vector<future<int>> v;
+  promise<int> p1, p2;
+  promise<void> deadline;
+  bool called = false;
+
+  v.push_back(future<int>([&](promise<int> p) {p1 = std::move(p); }));
+  v.push_back(future<int>([&](promise<int> p) {p2 = std::move(p); }));
+
+  when_all_until(std::move(v), future<void>([&](promise<void> p) {deadline = std::move(p); }))
+    .then([&](std::vector<std::optional<concrete_result<int>>> results) {
+      ASSERT_EQ(results.size(), 2);
+      ASSERT_FALSE(results[0].has_value());
+      ASSERT_TRUE(results[1].has_value());
+      ASSERT_TRUE(results[1]->success());
+      ASSERT_EQ(*results[1]->get_value(), 444);
+      called = true;
+    })
+    .ignore_result();
+
+  p2(444);
+  ASSERT_FALSE(called);
+
+  deadline({});
+  ASSERT_TRUE(called);
+
+  p1(123); // Stragglers are ignored
+}
+
+TEST(operations_when_all_until, empty_vector_returns_immediately) {
+  std::vector<future<void>> v;
+  bool called = false;
+
+  when_all_until(std::move(v), make_successful_future<void>())
+    .then([&](std::vector<std::optional<concrete_result<void>>> results) {
+      ASSERT_TRUE(results.empty());
+      called = true;
+    })
+    .ignore_result();
+
+  ASSERT_TRUE(called);
+}
+
+TEST(operations_when_any_variant, returns_first_result_with_its_index) {
+  promise<int> p1;
+  promise<std::string> p2;
+  bool called = false;
+
+  when_any(future<int>([&](promise<int> p) {p1 = std::move(p); }), future<std::string>([&](promise<std::string> p) {p2 = std::move(p); }))
+    .then([&](std::variant<int, std::string> winner) {
+      ASSERT_EQ(winner.index(), 1);
+      ASSERT_EQ(std::get<1>(winner), "fallback");
+      called = true;
+    })
+    .ignore_result();
+
+  p2(std::string{"fallback"});
+  ASSERT_TRUE(called);
+
+  p1(123); // Check that it doesn't crash
+}
+
+TEST(operations_when_any_variant, distinguishes_futures_of_the_same_type) {
+  promise<int> p1;
+  int index = -1;
+
+  when_any(future<int>([&](promise<int> p) {p1 = std::move(p); }), make_successful_future<void>(), make_successful_future<int>(2))
+    .then([&](std::variant<int, std::monostate, int> winner) {
+      index = static_cast<int>(winner.index());
+    })
+    .ignore_result();
+
+  ASSERT_EQ(index, 1);
+}
+
+TEST(operations_when_any_variant, returns_failure_if_first) {
+  promise<std::string> p2;
+  int error = 0;
+
+  when_any(make_failed_future<int>(444), future<std::string>([&](promise<std::string> p) {p2 = std::move(p); }))
+    .fail([&](int err) {
+      error = err;
+      return failure(std::move(err));
+    })
+    .ignore_result();
+
+  ASSERT_EQ(error, 444);
+  p2(std::string{"late"});
+}
@@ -0,0 +1,175 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+/// Built separately (`make pool`) since MINICOROS_FUNCTION_TYPE and MINICOROS_SHARED_STATE_ALLOCATOR have to be set
+/// for every translation unit that uses minicoros.
+
+#include <minicoros/pool.h>
+#include "testing.h"
+#include <minicoros/microtask_queue.h>
+#include <minicoros/operations.h>
+#include <minicoros/testing.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+using namespace mc;
+
+static_assert(std::is_same_v<continuation<int>, pooled_function<void(int&&)>>, "MINICOROS_FUNCTION_TYPE isn't set");
+
+TEST(pool, freed_blocks_are_reused) {
+  void* first = pool::allocate(40);
+  pool::deallocate(first, 40);
+
+  pool::statistics before = pool::stats();
+  void* second = pool::allocate(48); // Same size class
+  pool::statistics after = pool::stats();
+
+  ASSERT_EQ(second, first);
+  ASSERT_EQ(after.cache_hits, before.cache_hits + 1);
+  pool::deallocate(second, 48);
+}
+
+TEST(pool, oversized_allocations_bypass_the_pool) {
+  pool::statistics before = pool::stats();
+  void* ptr = pool::allocate(MINICOROS_POOL_MAX_BLOCK_SIZE + 1);
+  pool::deallocate(ptr, MINICOROS_POOL_MAX_BLOCK_SIZE + 1);
+
+  ASSERT_EQ(pool::stats().oversized, before.oversized + 1);
+  ASSERT_EQ(pool::stats().allocations, before.allocations);
+}
+
+TEST(pool, full_thread_caches_return_blocks_to_the_global_pool) {
+  std::vector<void*> blocks;
+
+  for (int i = 0; i < MINICOROS_POOL_THREAD_CACHE_SIZE * 2; ++i)
+    blocks.push_back(pool::allocate(200));
+
+  pool::statistics before = pool::stats();
+
+  // Free them on another thread, which hands them to the global pool for this thread to pick up again
+  std::thread{[&blocks] {
+    for (void* block : blocks)
+      pool::deallocate(block, 200);
+  }}.join();
+
+  ASSERT_TRUE((pool::stats().global_returns > before.global_returns));
+
+  for (int i = 0; i < MINICOROS_POOL_THREAD_CACHE_SIZE * 2; ++i)
+    blocks[i] = pool::allocate(200);
+
+  pool::statistics after = pool::stats();
+  ASSERT_TRUE((after.global_refills > before.global_refills));
+  ASSERT_EQ(after.system_allocations, before.system_allocations);
+
+  for (void* block : blocks)
+    pool::deallocate(block, 200);
+
+  pool::trim();
+}
+
+TEST(pooled_function, copies_and_moves_the_callable) {
+  auto counter = std::make_shared<int>(0);
+  pooled_function<int(int)> fun = [counter] (int value) { return ++*counter + value; };
+
+  pooled_function<int(int)> copy = fun;
+  ASSERT_EQ(fun(10), 11);
+  ASSERT_EQ(copy(10), 12);
+  ASSERT_EQ(counter.use_count(), 3);
+
+  pooled_function<int(int)> moved = std::move(copy);
+  ASSERT_FALSE(static_cast<bool>(copy));
+  ASSERT_EQ(moved(10), 13);
+
+  fun = nullptr;
+  moved = {};
+  ASSERT_FALSE(static_cast<bool>(fun));
+  ASSERT_EQ(counter.use_count(), 1);
+}
+
+TEST(pool, chains_run_without_touching_the_system_allocator_once_warm) {
+  auto run_chain = [] {
+    promise<int> p;
+    int value = 0;
+
+    future<int>([&] (promise<int> inner) { p = std::move(inner); })
+      .then([] (int value) -> result<int> { return value + 1; })
+      .then([&] (int result) { value = result; })
+      .ignore_result();
+
+    p(1);
+    return value;
+  };
+
+  ASSERT_EQ(run_chain(), 2);
+  pool::statistics before = pool::stats();
+  ASSERT_EQ(run_chain(), 2);
+  pool::statistics after = pool::stats();
+
+  ASSERT_EQ(after.system_allocations, before.system_allocations);
+  ASSERT_TRUE((after.allocations > before.allocations));
+  ASSERT_EQ(after.allocations - before.allocations, after.deallocations - before.deallocations);
+}
+
+TEST(pool, combinator_state_is_pooled) {
+  std::vector<future<int>> futures;
+  futures.push_back(make_successful_future<int>(1));
+  futures.push_back(make_successful_future<int>(2));
+
+  pool::statistics before = pool::stats();
+  assert_successful_result_eq(when_all(std::move(futures)).then([] (std::vector<int> values) -> result<int> {
+    return values[0] + values[1];
+  }), 3);
+
+  ASSERT_TRUE((pool::stats().allocations > before.allocations));
+}
+
+TEST(pool, blocks_can_be_freed_after_the_thread_cache_is_gone) {
+  struct frees_at_thread_exit {
+    void* block = nullptr;
+
+    ~frees_at_thread_exit() {
+      pool::deallocate(block, 240);
+    }
+  };
+
+  void* freed = nullptr;
+
+  std::thread{[&freed] {
+    thread_local frees_at_thread_exit holder; // Constructed before the thread's cache, so destroyed after it
+    holder.block = freed = pool::allocate(240);
+  }}.join();
+
+  // The block went to the global pool, where the next thread that runs out of blocks picks it up
+  void* reused = nullptr;
+
+  std::thread{[&reused] {
+    reused = pool::allocate(240);
+    pool::deallocate(reused, 240);
+  }}.join();
+
+  ASSERT_EQ(reused, freed);
+}
+
+TEST(pool, enqueued_work_is_pooled_by_the_microtask_queue) {
+  microtask_queue microtasks;
+
+  auto run_chain = [&microtasks] {
+    int value = 0;
+
+    make_successful_future<int>(1)
+      .enqueue(microtasks.executor())
+      .then([&] (int result) { value = result; })
+      .ignore_result();
+
+    microtasks.drain();
+    return value;
+  };
+
+  ASSERT_EQ(run_chain(), 1);
+  pool::statistics before = pool::stats();
+  ASSERT_EQ(run_chain(), 1);
+  pool::statistics after = pool::stats();
+
+  ASSERT_EQ(after.system_allocations, before.system_allocations);
+  ASSERT_EQ(after.allocations - before.allocations, after.deallocations - before.deallocations);
+}
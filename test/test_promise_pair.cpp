@@ -0,0 +1,96 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#include "testing.h"
+#include <minicoros/promise_pair.h>
+#include <minicoros/testing.h>
+#include <thread>
+
+using namespace testing;
+using namespace mc;
+
+namespace {
+
+struct fake_c_api {
+  void (*callback)(void*, int, int) = nullptr;
+  void* user_data = nullptr;
+
+  void complete(int status, int value) {
+    callback(user_data, status, value);
+  }
+};
+
+concrete_result<int> from_status(int status, int value) {
+  if (status != 0)
+    return failure{std::move(status)};
+
+  return {std::move(value)};
+}
+
+} // namespace
+
+TEST(promise_pair, resolving_before_evaluation_buffers_the_result) {
+  auto [p, fut] = make_promise_future_pair<int>();
+  p({123});
+
+  assert_successful_result_eq(std::move(fut), 123);
+}
+
+TEST(promise_pair, resolving_after_evaluation_runs_the_chain) {
+  auto [p, fut] = make_promise_future_pair<int>();
+  int value = 0;
+
+  std::move(fut).then([&] (int result) { value = result; }).ignore_result();
+  ASSERT_EQ(value, 0);
+
+  p({123});
+  ASSERT_EQ(value, 123);
+}
+
+TEST(promise_pair, resolves_across_threads) {
+  auto [p, fut] = make_promise_future_pair<int>();
+  std::thread resolver{[p = std::move(p)] () mutable { p({5}); }};
+  int value = 0;
+
+  std::move(fut).then([&] (int result) { value = result; }).ignore_result();
+  resolver.join();
+  ASSERT_EQ(value, 5);
+}
+
+TEST(promise_pair, c_trampoline_resolves_released_handle) {
+  auto [p, fut] = make_promise_future_pair<int>();
+  fake_c_api api{c_trampoline<int, &from_status>, p.release()};
+  ASSERT_FALSE(static_cast<bool>(p));
+
+  api.complete(7, 0);
+  assert_fail_eq(std::move(fut), 7);
+}
+
+TEST(promise_slot, resolves_without_allocating) {
+  promise_slot<int> slot;
+  fake_c_api api{c_trampoline<int, &from_status>, slot.c_user_data()};
+  int value = 0;
+
+  {
+    alloc_counter allocs;
+
+    future<int> fut = slot.get_future();
+    std::move(fut).chain().evaluate_into([&value] (concrete_result<int>&& result) { value = *result.get_value(); });
+    api.complete(0, 42);
+
+    ASSERT_EQ(allocs.total_allocation_count(), 0);
+  }
+
+  ASSERT_EQ(value, 42);
+}
+
+TEST(promise_slot, can_be_reused_after_it_has_resolved) {
+  promise_slot<int> slot;
+
+  slot({1});
+  assert_successful_result_eq(slot.get_future(), 1);
+
+  slot.reset();
+  future<int> fut = slot.get_future();
+  resolve_c_user_data<int>(slot.c_user_data(), {2});
+  assert_successful_result_eq(std::move(fut), 2);
+}
@@ -0,0 +1,165 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#include "testing.h"
+#include <minicoros/rate_limiter.h>
+#include <minicoros/testing.h>
+#include <chrono>
+#include <vector>
+
+using namespace testing;
+using namespace mc;
+using namespace std::chrono_literals;
+
+namespace {
+
+class fake_timer {
+public:
+  rate_limiter::clock::time_point now() const {
+    return now_;
+  }
+
+  void schedule(rate_limiter::clock::time_point when, rate_limiter::callback_type&& callback) {
+    timers_.push_back(timer{when, std::move(callback)});
+  }
+
+  void advance(rate_limiter::clock::duration duration) {
+    now_ += duration;
+
+    for (size_t i = 0; i < timers_.size();) {
+      if (timers_[i].when > now_) {
+        ++i;
+        continue;
+      }
+
+      auto callback = std::move(timers_[i].callback);
+      timers_.erase(timers_.begin() + i);
+      callback();
+      i = 0;
+    }
+  }
+
+  size_t num_timers() const {
+    return timers_.size();
+  }
+
+private:
+  struct timer {
+    rate_limiter::clock::time_point when;
+    rate_limiter::callback_type callback;
+  };
+
+  rate_limiter::clock::time_point now_;
+  std::vector<timer> timers_;
+};
+
+rate_limiter make_limiter(fake_timer& timer, double tokens_per_second, double burst) {
+  return rate_limiter{tokens_per_second, burst, 7,
+    [&timer] (auto when, auto&& callback) { timer.schedule(when, std::move(callback)); },
+    [&timer] { return timer.now(); }};
+}
+
+} // namespace
+
+TEST(rate_limiter, burst_is_available_immediately) {
+  fake_timer timer;
+  rate_limiter limiter = make_limiter(timer, 10, 3);
+  int num_acquired = 0;
+
+  for (int i = 0; i < 3; ++i)
+    limiter.acquire().then([&] { ++num_acquired; }).ignore_result();
+
+  ASSERT_EQ(num_acquired, 3);
+  ASSERT_EQ(timer.num_timers(), 0);
+}
+
+TEST(rate_limiter, waiters_resolve_as_tokens_refill) {
+  fake_timer timer;
+  rate_limiter limiter = make_limiter(timer, 10, 1); // One token every 100ms
+  int num_acquired = 0;
+
+  for (int i = 0; i < 3; ++i)
+    limiter.acquire().then([&] { ++num_acquired; }).ignore_result();
+
+  ASSERT_EQ(num_acquired, 1);
+  ASSERT_EQ(limiter.num_waiters(), 2);
+  ASSERT_EQ(timer.num_timers(), 1);
+
+  timer.advance(50ms);
+  ASSERT_EQ(num_acquired, 1);
+
+  timer.advance(51ms);
+  ASSERT_EQ(num_acquired, 2);
+
+  timer.advance(101ms);
+  ASSERT_EQ(num_acquired, 3);
+  ASSERT_EQ(limiter.num_waiters(), 0);
+  ASSERT_EQ(timer.num_timers(), 0);
+}
+
+TEST(rate_limiter, waiters_are_served_in_fifo_order) {
+  fake_timer timer;
+  rate_limiter limiter = make_limiter(timer, 10, 5);
+  std::vector<int> order;
+
+  limiter.acquire(5).then([&] { order.push_back(0); }).ignore_result();
+  limiter.acquire(4).then([&] { order.push_back(1); }).ignore_result();
+  limiter.acquire(1).then([&] { order.push_back(2); }).ignore_result(); // Would fit earlier, but has to queue
+
+  ASSERT_EQ(order.size(), 1);
+
+  timer.advance(401ms);
+  ASSERT_EQ(order.size(), 2);
+  ASSERT_EQ(order[1], 1);
+
+  timer.advance(101ms);
+  ASSERT_EQ(order.size(), 3);
+  ASSERT_EQ(order[2], 2);
+}
+
+TEST(rate_limiter, pending_waiters_outlive_the_limiter) {
+  fake_timer timer;
+  bool acquired = false;
+
+  {
+    rate_limiter limiter = make_limiter(timer, 10, 1);
+    limiter.acquire().ignore_result();
+    limiter.acquire().then([&] { acquired = true; }).ignore_result();
+  }
+
+  timer.advance(200ms);
+  ASSERT_TRUE(acquired);
+}
+
+TEST(rate_limiter, requests_larger_than_the_burst_fail) {
+  fake_timer timer;
+  rate_limiter limiter = make_limiter(timer, 10, 2);
+
+  assert_fail_eq(limiter.acquire(3), 7);
+  ASSERT_EQ(limiter.num_waiters(), 0);
+  ASSERT_EQ(timer.num_timers(), 0);
+
+  // The queue isn't blocked
+  assert_successful_result(limiter.acquire(2));
+}
+
+TEST(rate_limiter, negative_requests_fail) {
+  fake_timer timer;
+  rate_limiter limiter = make_limiter(timer, 10, 2);
+
+  assert_fail_eq(limiter.acquire(-5), 7);
+
+  // No tokens were added beyond the burst
+  assert_successful_result(limiter.acquire(2));
+  limiter.acquire(1).ignore_result();
+  ASSERT_EQ(limiter.num_waiters(), 1);
+}
+
+TEST(rate_limiter, limiters_without_a_positive_rate_reject_all_requests) {
+  fake_timer timer;
+  rate_limiter stalled = make_limiter(timer, 0, 2);
+  rate_limiter reversed = make_limiter(timer, -1, 2);
+
+  assert_fail_eq(stalled.acquire(), 7);
+  assert_fail_eq(reversed.acquire(), 7);
+  ASSERT_EQ(timer.num_timers(), 0);
+}
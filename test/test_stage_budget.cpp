@@ -0,0 +1,99 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#include "testing.h"
+#include <minicoros/operations.h>
+#include <minicoros/testing.h>
+#include <functional>
+#include <vector>
+
+using namespace testing;
+using namespace mc;
+
+namespace {
+
+class work_queue {
+public:
+  void enqueue_work(std::function<void()> item) {
+    work_items_.push_back(std::move(item));
+  }
+
+  /// Runs the queued items, each with a fresh budget
+  void execute(size_t max_stages) {
+    std::vector<std::function<void()>> items = std::move(work_items_);
+
+    for (auto& item : items) {
+      stage_budget budget{[this] (stage_budget::work_type&& work) { enqueue_work(std::move(work)); }, max_stages};
+      item();
+    }
+  }
+
+  size_t size() const {
+    return work_items_.size();
+  }
+
+private:
+  std::vector<std::function<void()>> work_items_;
+};
+
+future<int> make_long_chain(int num_stages) {
+  future<int> fut = make_successful_future<int>(0);
+
+  for (int i = 0; i < num_stages; ++i)
+    fut = std::move(fut).then([] (int value) -> result<int> { return value + 1; });
+
+  return fut;
+}
+
+} // namespace
+
+TEST(stage_budget, chains_run_inline_without_budget) {
+  int value = 0;
+  make_long_chain(10).then([&] (int result) { value = result; }).ignore_result();
+  ASSERT_EQ(value, 10);
+}
+
+TEST(stage_budget, exhausted_budget_reschedules_the_rest_of_the_chain) {
+  work_queue queue;
+  int value = 0;
+
+  queue.enqueue_work([&] {
+    make_long_chain(10).then([&] (int result) { value = result; }).ignore_result();
+  });
+
+  queue.execute(4);
+  ASSERT_EQ(value, 0);
+  ASSERT_EQ(queue.size(), 1);
+
+  queue.execute(4);
+  queue.execute(4);
+  ASSERT_EQ(value, 10);
+  ASSERT_EQ(queue.size(), 0);
+}
+
+TEST(stage_budget, budgets_nest) {
+  work_queue queue;
+  auto enqueue = [&queue] (stage_budget::work_type&& work) { queue.enqueue_work(std::move(work)); };
+
+  stage_budget outer{enqueue, 100};
+
+  {
+    stage_budget inner{enqueue, 1};
+    ASSERT_EQ(stage_budget::current(), &inner);
+  }
+
+  ASSERT_EQ(stage_budget::current(), &outer);
+}
+
+TEST(stage_budget, yield_resolves_through_the_executor) {
+  work_queue queue;
+  bool called = false;
+
+  make_successful_future<void>()
+    .then([&] () -> result<void> { return yield([&queue] (auto&& work) { queue.enqueue_work(std::move(work)); }); })
+    .then([&] { called = true; })
+    .ignore_result();
+
+  ASSERT_FALSE(called);
+  queue.execute(100);
+  ASSERT_TRUE(called);
+}
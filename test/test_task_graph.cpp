@@ -0,0 +1,130 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#include "testing.h"
+#include <minicoros/task_graph.h>
+#include <minicoros/testing.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace testing;
+using namespace mc;
+
+TEST(task_graph, passes_results_along_edges) {
+  task_graph<int> graph;
+  auto a = graph.add_node([] (task_inputs<int>) { return make_successful_future<int>(2); });
+  auto b = graph.add_node([] (task_inputs<int>) { return make_successful_future<int>(3); });
+  auto product = graph.add_node([] (task_inputs<int> in) {
+    return make_successful_future<int>(in[0] * in[1]);
+  }, {a, b});
+  auto sum = graph.add_node([] (task_inputs<int> in) {
+    return make_successful_future<int>(in[0] + in[1] + in[2]);
+  }, {a, b, product});
+
+  assert_successful_result_eq(std::move(graph).run(sum), 11);
+}
+
+TEST(task_graph, nodes_start_once_their_dependencies_have_resolved) {
+  task_graph<int> graph;
+  promise<int> slow;
+  std::vector<std::string> started;
+
+  auto a = graph.add_node([&] (task_inputs<int>) {
+    started.push_back("a");
+    return future<int>([&] (promise<int>&& p) { slow = std::move(p); });
+  });
+  auto b = graph.add_node([&] (task_inputs<int>) {
+    started.push_back("b");
+    return make_successful_future<int>(1);
+  });
+  auto c = graph.add_node([&] (task_inputs<int> in) {
+    started.push_back("c");
+    return make_successful_future<int>(in[0] + 1);
+  }, {b});
+  auto d = graph.add_node([&] (task_inputs<int> in) {
+    started.push_back("d");
+    return make_successful_future<int>(in[0] + in[1]);
+  }, {a, c});
+
+  int result = 0;
+  std::move(graph).run(d).then([&] (int value) { result = value; }).ignore_result();
+
+  ASSERT_EQ(started.size(), 3); // d waits for a
+  ASSERT_EQ(started[2], "c");
+
+  slow(10);
+  ASSERT_EQ(started.size(), 4);
+  ASSERT_EQ(result, 12);
+}
+
+TEST(task_graph, ready_nodes_start_in_critical_path_order) {
+  task_graph<int> graph;
+  std::vector<std::string> started;
+  graph.set_max_concurrency(1);
+
+  auto make_task = [&] (std::string name) {
+    return [&started, name] (task_inputs<int>) {
+      started.push_back(name);
+      return make_successful_future<int>(1);
+    };
+  };
+
+  auto cheap = graph.add_node(make_task("cheap"), {}, 1);
+  auto head = graph.add_node(make_task("head"), {}, 1);
+  auto expensive_tail = graph.add_node(make_task("expensive_tail"), {head}, 100);
+  auto sink = graph.add_node(make_task("sink"), {cheap, expensive_tail}, 1);
+
+  assert_successful_result_eq(std::move(graph).run(sink), 1);
+
+  ASSERT_EQ(started.size(), 4);
+  ASSERT_EQ(started[0], "head");
+  ASSERT_EQ(started[1], "expensive_tail");
+  ASSERT_EQ(started[2], "cheap");
+  ASSERT_EQ(started[3], "sink");
+}
+
+TEST(task_graph, failure_stops_the_graph) {
+  task_graph<int> graph;
+  bool dependent_started = false;
+
+  auto a = graph.add_node([] (task_inputs<int>) { return make_failed_future<int>(5); });
+  auto b = graph.add_node([&] (task_inputs<int>) {
+    dependent_started = true;
+    return make_successful_future<int>(1);
+  }, {a});
+
+  assert_fail_eq(std::move(graph).run(b), 5);
+  ASSERT_FALSE(dependent_started);
+}
+
+TEST(task_graph, long_synchronous_chains_dont_recurse) {
+  task_graph<int> graph;
+  auto previous = graph.add_node([] (task_inputs<int>) { return make_successful_future<int>(0); });
+
+  for (int i = 0; i < 5000; ++i) {
+    previous = graph.add_node([] (task_inputs<int> in) {
+      return make_successful_future<int>(in[0] + 1);
+    }, {previous});
+  }
+
+  assert_successful_result_eq(std::move(graph).run(previous), 5000);
+}
+
+TEST(task_graph, dependencies_can_be_built_at_runtime) {
+  task_graph<int> graph;
+  std::vector<task_graph<int>::node_id> leaves;
+
+  for (int i = 1; i <= 10; ++i)
+    leaves.push_back(graph.add_node([i] (task_inputs<int>) { return make_successful_future<int>(i); }));
+
+  auto sum = graph.add_node([] (task_inputs<int> in) {
+    int total = 0;
+
+    for (size_t i = 0; i < in.size(); ++i)
+      total += in[i];
+
+    return make_successful_future<int>(total);
+  }, leaves, 5);
+
+  assert_successful_result_eq(std::move(graph).run(sum), 55);
+}
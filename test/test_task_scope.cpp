@@ -0,0 +1,184 @@
+/// Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+
+#include "testing.h"
+#include <minicoros/task_scope.h>
+#include <minicoros/testing.h>
+#include <string>
+
+using namespace testing;
+using namespace mc;
+
+TEST(task_scope, children_are_started_when_spawned) {
+  task_scope scope{446};
+  bool called = false;
+
+  scope.spawn(make_successful_future<void>().then([&] { called = true; }));
+
+  ASSERT_TRUE(called);
+}
+
+TEST(task_scope, join_waits_for_all_children) {
+  task_scope scope{446};
+  promise<int> p1;
+  promise<std::string> p2;
+  bool joined = false;
+
+  scope.spawn(future<int>([&](promise<int> p) {p1 = std::move(p); }));
+  scope.spawn(future<std::string>([&](promise<std::string> p) {p2 = std::move(p); }));
+
+  scope.join()
+    .then([&] { joined = true; })
+    .ignore_result();
+
+  p1(123);
+  ASSERT_FALSE(joined);
+
+  p2(std::string{"done"});
+  ASSERT_TRUE(joined);
+}
+
+TEST(task_scope, join_without_children_resolves_immediately) {
+  task_scope scope{446};
+  assert_successful_result(scope.join());
+}
+
+TEST(task_scope, join_returns_first_failure) {
+  task_scope scope{446};
+  promise<int> p1;
+
+  scope.spawn(future<int>([&](promise<int> p) {p1 = std::move(p); }));
+  scope.spawn(make_failed_future<void>(444));
+  scope.spawn(make_failed_future<int>(445));
+
+  int error = 0;
+
+  scope.join()
+    .fail([&](int err) {
+      error = err;
+      return failure(std::move(err));
+    })
+    .ignore_result();
+
+  ASSERT_EQ(error, 0);
+  p1(123);
+  ASSERT_EQ(error, 444);
+
+  assert_successful_result(scope.join()); // The failure was consumed by the first join
+}
+
+TEST(task_scope, children_outlive_the_scope) {
+  promise<int> p1;
+  bool joined = false;
+
+  {
+    task_scope scope{446};
+    scope.spawn(future<int>([&](promise<int> p) {p1 = std::move(p); }));
+
+    scope.join()
+      .then([&] { joined = true; })
+      .ignore_result();
+  }
+
+  ASSERT_FALSE(joined);
+  p1(123);
+  ASSERT_TRUE(joined);
+}
+
+TEST(task_scope, children_are_created_in_the_scope_context) {
+  task_scope scope{446};
+  bool has_context = false;
+
+  scope.spawn([&] {
+    return make_successful_future<void>().then([&] { has_context = current_context() != nullptr; });
+  });
+
+  ASSERT_TRUE(has_context);
+  ASSERT_EQ(current_context(), nullptr);
+}
+
+TEST(task_scope, children_are_cancelled_when_the_scope_ends) {
+  promise<int> p1;
+  bool called = false;
+
+  {
+    task_scope scope{446};
+
+    scope.spawn([&] {
+      return future<int>([&](promise<int> p) {p1 = std::move(p); })
+        .then([&] (int) { called = true; });
+    });
+  }
+
+  p1(123);
+  ASSERT_FALSE(called);
+}
+
+TEST(task_scope, pending_join_keeps_children_running) {
+  promise<int> p1;
+  bool called = false;
+
+  auto make_joined_scope = [&] {
+    task_scope scope{446};
+
+    scope.spawn([&] {
+      return future<int>([&](promise<int> p) {p1 = std::move(p); })
+        .then([&] (int) { called = true; });
+    });
+
+    return scope.join();
+  };
+
+  future<void> joined = make_joined_scope();
+  bool resolved = false;
+  std::move(joined).then([&] { resolved = true; }).ignore_result();
+
+  ASSERT_FALSE(resolved);
+  p1(123);
+  ASSERT_TRUE(called);
+  ASSERT_TRUE(resolved);
+}
+
+TEST(task_scope, dropped_join_cancels_children_of_a_destroyed_scope) {
+  promise<int> p1;
+  bool called = false;
+
+  {
+    future<void> joined = [&] {
+      task_scope scope{446};
+
+      scope.spawn([&] {
+        return future<int>([&](promise<int> p) {p1 = std::move(p); })
+          .then([&] (int) { called = true; });
+      });
+
+      return scope.join();
+    }();
+
+    joined.freeze();
+  }
+
+  p1(123);
+  ASSERT_FALSE(called);
+}
+
+TEST(task_scope, cancel_fails_running_and_later_children) {
+  task_scope scope{446};
+  promise<int> p1;
+  int num_called = 0;
+
+  scope.spawn([&] {
+    return future<int>([&](promise<int> p) {p1 = std::move(p); })
+      .then([&] (int) { ++num_called; });
+  });
+
+  scope.cancel();
+  ASSERT_TRUE(scope.cancelled());
+
+  scope.spawn([&] {
+    return make_successful_future<void>().then([&] { ++num_called; });
+  });
+
+  p1(123);
+  ASSERT_EQ(num_called, 0);
+  assert_fail_eq(scope.join(), 446);
+}
@@ -0,0 +1,36 @@
+# Copyright (C) 2022 Electronic Arts Inc.  All rights reserved.
+#
+# GDB helpers for Minicoros. Requires a build with MINICOROS_ENABLE_ASYNC_FRAMES and debug info.
+#
+#   (gdb) source tools/gdb/minicoros.py
+#   (gdb) mc-async-stack            # logical async stack of the selected thread
+#   (gdb) thread apply all mc-async-stack
+
+import gdb
+
+
+class AsyncStackCommand(gdb.Command):
+    """Prints the logical async stack (mc::async_frame) of the stage running on the selected thread."""
+
+    def __init__(self):
+        super(AsyncStackCommand, self).__init__("mc-async-stack", gdb.COMMAND_STACK)
+
+    def invoke(self, arg, from_tty):
+        try:
+            frame_ptr = gdb.parse_and_eval("mc::detail::current_async_frame")
+        except gdb.error as e:
+            print("mc-async-stack: %s (was the program built with MINICOROS_ENABLE_ASYNC_FRAMES?)" % e)
+            return
+
+        if int(frame_ptr) == 0:
+            print("<no async frame>")
+            return
+
+        frame = frame_ptr.dereference()
+
+        for i in range(int(frame["depth"])):
+            location = frame["locations"][i]
+            print("#%d %s:%d" % (i, location["file"].string(), int(location["line"])))
+
+
+AsyncStackCommand()